@@ -20,6 +20,8 @@ function init()
     selectedEntities = {}
     newSelectedEntity = nil
     usingGizmo = false
+    -- Where the entity being moved with the gizmo was when the move started
+    gizmoStartFootprint = nil
 
     enemySpawns = {}
     enemyGoals = {}
@@ -112,9 +114,12 @@ function imgui()
         end
     end
     if Raylib.IsKeyPressed(Raylib.Key.DELETE) then
+        local footprints = {}
         for k in pairs(selectedEntities) do
+            table.insert(footprints, Navigation.GetFootprint(k))
             Entity.Destroy(k)
         end
+        NavigationTools.Update(footprints)
 
         for k in pairs(selectedEntities) do selectedEntities[k] = nil end
     end
@@ -201,13 +206,17 @@ function imgui()
                         if placeFloorType == PlaceFloorType.GOAL then
                             EntityTools.AddComponentOrPrintError("EnemyGoal", entity, { id = 0 })
                         end
+
+                        NavigationTools.Update({ Navigation.GetFootprint(entity) })
                     end
                 end
             elseif Raylib.IsMouseButtonDown(1) then
                 local ray = Raylib.GetMouseRay(Raylib.GetMousePosition())
                 local hitEntity = Raylib.GetRayCollision(ray)
                 if hitEntity ~= nil then
+                    local footprint = Navigation.GetFootprint(hitEntity)
                     Entity.Destroy(hitEntity)
+                    NavigationTools.Update({ footprint })
                 end
             end
         end
@@ -248,38 +257,45 @@ function imgui()
 
         if selectedEntitiesCount == 1 then
             ImGuizmo.Gizmo(firstEntity, not usingGizmo)
+            local wasUsingGizmo = usingGizmo
             usingGizmo = ImGuizmo.IsUsing()
+
+            -- The tiles are updated once the entity has been let go of, both where it was and
+            -- where it is now
+            if usingGizmo and not wasUsingGizmo then
+                gizmoStartFootprint = Navigation.GetFootprint(firstEntity)
+            elseif wasUsingGizmo and not usingGizmo then
+                NavigationTools.Update({ gizmoStartFootprint, Navigation.GetFootprint(firstEntity) })
+                gizmoStartFootprint = nil
+            end
         else
             usingGizmo = false
         end
     end
 
     if menuBarState.drawTileInfo or menuBarState.drawWalkerInfo then
-        for y = 1, #walkerMap do
-            for x = 1, #walkerMap[y] do
+        local fieldId <const> = (drawFieldId << 16) | drawFieldGoalId
+        for y = 1, Navigation.sizeY do
+            for x = 1, Navigation.sizeX do
                 local pos = Raylib.GetWorldToScreen({
                     x = x * Navigation.tileSize + Navigation.offsetX - Navigation.tileSize / 2,
                     y = 0.25,
                     z = y * Navigation.tileSize + Navigation.offsetY - Navigation.tileSize / 2
                 })
-                if pos.x > 0 and pos.y > 0 then
+                local walker = Navigation.GetWalkerTile(fieldId, x - 1, y - 1)
+                if walker and pos.x > 0 and pos.y > 0 then
                     if menuBarState.drawWalkerInfo then
-                        if walkerMap[y][x].wallId ~= -1 then
-                            Raylib.DrawText(walkerMap[y][x].id, pos.x, pos.y - 14, 12)
-                            Raylib.DrawText(walkerMap[y][x].distance, pos.x, pos.y, 12)
-                            Raylib.DrawText(walkerMap[y][x].wallId, pos.x, pos.y + 14, 12)
-                            --Raylib.DrawText(wallMap[y][x].distanceAlongWall, pos.x, pos.y + 28, 12)
-                            if walkerMap[y][x].parentDirection == "none" then
-                                Raylib.DrawText(walkerMap[y][x].parentDirection, pos.x, pos.y + 28, 20)
-                            else
-                                Raylib.DrawText(walkerMap[y][x].parentDirection, pos.x, pos.y + 28, 12)
-                            end
+                        if walker.wallId ~= -1 then
+                            Raylib.DrawText(walker.id, pos.x, pos.y - 14, 12)
+                            Raylib.DrawText(walker.distance, pos.x, pos.y, 12)
+                            Raylib.DrawText(walker.wallId, pos.x, pos.y + 14, 12)
+                            Raylib.DrawText(walker.parentDirection, pos.x, pos.y + 28, 12)
                         end
                     elseif menuBarState.drawTileInfo then
                         Raylib.DrawText(x .. "x" .. y, pos.x, pos.y - 14, 12)
-                        Raylib.DrawText(tileMap[y][x].distance, pos.x, pos.y + 0, 12)
-                        Raylib.DrawText(tileMap[y][x].distanceToUnpassable, pos.x, pos.y + 14, 12)
-                        if tileMap[y][x].locked then
+                        Raylib.DrawText(walker.distance, pos.x, pos.y + 0, 12)
+                        Raylib.DrawText(walker.distanceToUnpassable, pos.x, pos.y + 14, 12)
+                        if walker.locked then
                             Raylib.DrawText("locked", pos.x, pos.y + 28, 12)
                         end
                     end
@@ -174,13 +174,40 @@ local function Window()
             if ImGui.MenuItem("Smooth field", "", navigationState.smoothField, true) then
                 navigationState.smoothField = not navigationState.smoothField
             end
+            if ImGui.MenuItem("Hierarchical field", "", navigationState.hierarchicalField, true) then
+                navigationState.hierarchicalField = not navigationState.hierarchicalField
+            end
 
             _, navigationState.tileSize = ImGui.InputFloat("Tile size", navigationState.tileSize, 0.1, 0.1)
             _, Navigation.ksi = ImGui.InputFloat("KSI", Navigation.ksi, 0.1, 0.1)
+            local avoidanceModels = { "forces", "orca", "density" }
+            local selectedModel = 0
+            for i, model in ipairs(avoidanceModels) do
+                if Navigation.avoidanceModel == model then
+                    selectedModel = i - 1
+                end
+            end
+            ImGui.Text("Avoidance model")
+            for i, model in ipairs(avoidanceModels) do
+                if ImGui.RadioButtonMult(model, selectedModel, i - 1) then
+                    Navigation.avoidanceModel = model
+                end
+            end
             _, Navigation.avoidanceLookAhead = ImGui.DragFloat("Avoidance look-ahead", Navigation.avoidanceLookAhead, 0.1,
                 0.0, 10.0)
             _, Navigation.obstacleLookAhead = ImGui.DragFloat("Obstacle look-ahead", Navigation.obstacleLookAhead, 0.1,
                 0.0, 10.0)
+            if ImGui.MenuItem("Interpolate forces", "", Navigation.interpolateForces, true) then
+                Navigation.interpolateForces = not Navigation.interpolateForces
+            end
+            if ImGui.MenuItem("Parallel steering", "", Navigation.parallelSteering, true) then
+                Navigation.parallelSteering = not Navigation.parallelSteering
+            end
+            if ImGui.MenuItem("Fused steering", "", Navigation.fusedSteering, true) then
+                Navigation.fusedSteering = not Navigation.fusedSteering
+            end
+            _, Navigation.steeringLodInterval = ImGui.InputInt("Steering LOD interval",
+                Navigation.steeringLodInterval, 1)
 
             ImGui.Separator()
 
@@ -66,6 +66,12 @@ local function LoadLevel(name)
     end
 end
 
+---@param name string name of level without any file types
+---@return string path the baked navigation of the level is cached at
+local function GetNavigationCachePath(name)
+    return "../assets/levels/" .. name .. ".nav"
+end
+
 local function NewLevel()
     Entity.ClearRegistry()
 
@@ -86,4 +92,5 @@ return {
     SaveLevel = SaveLevel,
     LoadLevel = LoadLevel,
     NewLevel = NewLevel,
+    GetNavigationCachePath = GetNavigationCachePath,
 }
@@ -23,7 +23,8 @@ local function DrawButtonCenter(text, posX, posY, size, width)
 end
 
 function init()
-    Level.LoadLevel(StartLevel or "level1")
+    local levelName = StartLevel or "level1"
+    Level.LoadLevel(levelName)
 
     common.playState.enemySpawns = {}
     common.playState.enemyGoals = {}
@@ -38,7 +39,7 @@ function init()
 
     common.playState.waveState = common.waveStates.NOT_STARTED
 
-    NavigationTools.Build()
+    NavigationTools.Build(Level.GetNavigationCachePath(levelName))
 end
 
 function raylib2D()
@@ -0,0 +1,171 @@
+// Compares GetAvoidanceForces against going through the neighbours one at a time, the way
+// System::AvoidEntities used to. Build with -DBUILD_BENCHMARKS=ON, and in release, the numbers are
+// meaningless otherwise
+
+#include <avoidance.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+    constexpr float RADIUS = 0.30f;
+    constexpr float AVOIDANCE_T = 2.0f;
+
+    struct Agent
+    {
+        Vector2 position;
+        Vector2 velocity;
+        NeighbourBatch neighbours;
+    };
+
+    // The loop from System::AvoidEntities before the neighbours were batched
+    AvoidanceForces GetAvoidanceForcesPerPair(const Agent& agent)
+    {
+        AvoidanceForces forces = {.separation = Vector2Zero(), .avoidance = Vector2Zero()};
+        const Vector2 position = agent.position;
+        const Vector2 velocity = agent.velocity;
+        const NeighbourBatch& neighbours = agent.neighbours;
+
+        for(size_t i = 0; i < neighbours.Size(); ++i)
+        {
+            const Vector2 otherPosition = {neighbours.positionX[i], neighbours.positionY[i]};
+            const Vector2 otherVelocity = {neighbours.velocityX[i], neighbours.velocityY[i]};
+            const float distance = neighbours.distance[i];
+
+            if(distance < 1.0f)
+            {
+                forces.separation = Vector2Add(
+                    forces.separation,
+                    Vector2Scale(Vector2DirectionTo(otherPosition, position), 1.0f / distance));
+            }
+
+            std::optional<float> timeToCollision =
+                TimeToCollisionSphere(position, otherPosition, velocity, otherVelocity, RADIUS);
+            if(!timeToCollision.has_value())
+                continue;
+
+            float t = timeToCollision.value();
+            Vector2 avoidanceForce;
+            float magnitude = 0.0f;
+            if(t == 0.0f)
+            {
+                avoidanceForce = Vector2DirectionTo(otherPosition, position);
+                magnitude = std::min(Vector2Length(velocity), 10.0f);
+            }
+            else
+            {
+                avoidanceForce = Vector2Normalize(Vector2Subtract(
+                    Vector2Add(position, Vector2Scale(velocity, t)),
+                    Vector2Add(otherPosition, Vector2Scale(otherVelocity, t))));
+                if(t >= 0.0f && t < AVOIDANCE_T)
+                    magnitude = std::min((AVOIDANCE_T - t) / (t + 0.001f), 20.0f);
+            }
+            forces.avoidance =
+                Vector2Add(forces.avoidance, Vector2Scale(avoidanceForce, magnitude));
+        }
+
+        return forces;
+    }
+
+    // Roughly what a crowd pushing towards a goal looks like within AVOIDANCE_RANGE
+    std::vector<Agent> CreateAgents(size_t agentCount, size_t neighbourCount)
+    {
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> offset(-3.0f, 3.0f);
+        std::uniform_real_distribution<float> speed(-2.0f, 2.0f);
+
+        std::vector<Agent> agents(agentCount);
+        for(Agent& agent : agents)
+        {
+            agent.position = {offset(random), offset(random)};
+            agent.velocity = {speed(random), speed(random)};
+            for(size_t i = 0; i < neighbourCount; ++i)
+            {
+                const Vector2 position = {
+                    agent.position.x + offset(random),
+                    agent.position.y + offset(random)};
+                agent.neighbours.Add(
+                    position,
+                    {speed(random), speed(random)},
+                    std::max(Vector2Distance(agent.position, position), 0.01f));
+            }
+        }
+        return agents;
+    }
+
+    template<typename Func>
+    double Time(const std::vector<Agent>& agents, int iterations, Vector2& checksum, Func func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; ++i)
+        {
+            for(const Agent& agent : agents)
+            {
+                const AvoidanceForces forces = func(agent);
+                checksum = Vector2Add(checksum, Vector2Add(forces.separation, forces.avoidance));
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
+
+int main()
+{
+    constexpr size_t AGENT_COUNT = 2048;
+    constexpr int ITERATIONS = 50;
+
+    // Biggest difference between the two, relative to the size of the force
+    float maxError = 0.0f;
+
+    for(size_t neighbourCount : {4, 8, 16, 32, 64})
+    {
+        const std::vector<Agent> agents = CreateAgents(AGENT_COUNT, neighbourCount);
+
+        for(const Agent& agent : agents)
+        {
+            const AvoidanceForces expected = GetAvoidanceForcesPerPair(agent);
+            const AvoidanceForces actual = GetAvoidanceForces(
+                agent.neighbours,
+                agent.position,
+                agent.velocity,
+                RADIUS,
+                AVOIDANCE_T);
+            const float scale = 1.0f
+                                + std::max(
+                                    Vector2Length(expected.separation),
+                                    Vector2Length(expected.avoidance));
+            maxError = std::max(
+                maxError,
+                Vector2Distance(expected.separation, actual.separation) / scale);
+            maxError = std::max(
+                maxError,
+                Vector2Distance(expected.avoidance, actual.avoidance) / scale);
+        }
+
+        Vector2 checksum = Vector2Zero();
+        const double perPair = Time(agents, ITERATIONS, checksum, GetAvoidanceForcesPerPair);
+        const double batched = Time(agents, ITERATIONS, checksum, [](const Agent& agent) {
+            return GetAvoidanceForces(
+                agent.neighbours,
+                agent.position,
+                agent.velocity,
+                RADIUS,
+                AVOIDANCE_T);
+        });
+
+        std::printf(
+            "%2zu neighbours: per pair %8.2f ms, batched %8.2f ms, %5.2fx (checksum %g)\n",
+            neighbourCount,
+            perPair,
+            batched,
+            perPair / batched,
+            checksum.x + checksum.y);
+    }
+
+    std::printf("Largest relative difference: %g\n", maxError);
+    return maxError < 1e-3f ? 0 : 1;
+}
@@ -0,0 +1,617 @@
+// Runs dense waves through the bundled levels with every avoidance model, see
+// System::AvoidanceModel. Build with -DBUILD_BENCHMARKS=ON, and in release, the timings are
+// meaningless otherwise
+//
+// Also checks that steering on the thread pool gives bit-identical results to steering on one
+// thread, and returns non-zero if it doesn't
+//
+// Nothing opens a window, so navigation is built the same way as Navigation.Build but with the
+// bounding boxes read straight from the .obj files instead of from loaded models
+
+#include <entt/entt.hpp>
+#include <external/lua.hpp>
+#include <external/raylib.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <navigation.hpp>
+#include <thread_pool.hpp>
+
+#include <component/acceleration.hpp>
+#include <component/health.hpp>
+#include <component/move_towards.hpp>
+#include <component/transform.hpp>
+#include <component/velocity.hpp>
+
+#include <system/move_entities.hpp>
+#include <system/steer_agents.hpp>
+#include <system/steering_lod.hpp>
+
+namespace
+{
+    // Same as the defaults in the Navigation table and navigation_tools.lua
+    constexpr float TILE_SIZE = 0.5f;
+    constexpr float KSI = 6.0f;
+    constexpr float AVOIDANCE_T = 3.0f;
+    constexpr float OBSTACLE_T = 2.0f;
+    constexpr float TIME = 1.0f / 60.0f;
+
+    // A lot denser than the waves in the game, which is where the models differ
+    constexpr uint32_t WAVE_SIZE = 100;
+    constexpr uint32_t SPAWN_INTERVAL = 6;
+    constexpr uint32_t MAX_FRAMES = 60 * 120;
+    constexpr float AGENT_SPEED = 1.5f;
+    // Agents are 0.6 across, closer than this and they are inside each other rather than touching
+    constexpr float OVERLAP_DISTANCE = 0.5f;
+    // Long enough for every wave to have spawned
+    constexpr uint32_t CHECK_FRAMES = WAVE_SIZE * SPAWN_INTERVAL;
+
+    const char* LEVELS[] = {"Fork and join", "Roundabout", "Turning Point"};
+
+    struct LevelEntity
+    {
+        Vector3 position;
+        Vector3 rotation;
+        std::string assetName;
+        bool walkable;
+        bool navGate;
+        uint32_t allowedGoalMask;
+        bool goal;
+        uint32_t goalMask;
+        bool spawn;
+        uint32_t spawnId;
+        uint32_t goalId;
+    };
+
+    struct Level
+    {
+        Navigation navigation;
+        std::vector<Vector3> spawnPositions;
+        std::vector<uint32_t> spawnFieldIds;
+    };
+
+    // Only used by the benchmark to see how much the velocity changes between frames
+    struct LastVelocity
+    {
+        Vector2 velocity;
+    };
+
+    struct Result
+    {
+        double steeringMs = 0.0;
+        uint32_t steeringFrames = 0;
+        uint32_t frames = 0;
+        uint32_t reachedGoal = 0;
+        uint64_t agentFrames = 0;
+        uint64_t overlappingPairs = 0;
+        double velocityChange = 0.0;
+        uint64_t cappedChanges = 0;
+    };
+
+    float GetNumber(lua_State* lua, int index, const char* name)
+    {
+        lua_getfield(lua, index, name);
+        const float value = (float)lua_tonumber(lua, -1);
+        lua_pop(lua, 1);
+        return value;
+    }
+
+    Vector3 GetVector3(lua_State* lua, int index, const char* name)
+    {
+        lua_getfield(lua, index, name);
+        const int table = lua_absindex(lua, -1);
+        const Vector3 value = {
+            .x = GetNumber(lua, table, "x"),
+            .y = GetNumber(lua, table, "y"),
+            .z = GetNumber(lua, table, "z"),
+        };
+        lua_pop(lua, 1);
+        return value;
+    }
+
+    // Same as toMask in Navigation.Build
+    uint32_t GetMask(lua_State* lua, int index, const char* name)
+    {
+        uint32_t mask = 0;
+        lua_getfield(lua, index, name);
+        const lua_Unsigned count = lua_rawlen(lua, -1);
+        for(lua_Unsigned i = 1; i <= count; ++i)
+        {
+            lua_rawgeti(lua, -1, (lua_Integer)i);
+            const auto id = (uint32_t)lua_tointeger(lua, -1);
+            if(id < Navigation::MAX_GOAL_ID)
+                mask |= 1u << id;
+            lua_pop(lua, 1);
+        }
+        lua_pop(lua, 1);
+        return mask;
+    }
+
+    // Pushes the component table if the entity at `index` has it, otherwise pushes nothing
+    bool GetComponent(lua_State* lua, int index, const char* name)
+    {
+        if(lua_getfield(lua, index, name) == LUA_TTABLE)
+            return true;
+
+        lua_pop(lua, 1);
+        return false;
+    }
+
+    // Levels are saved as a table of entity id -> table of components
+    bool LoadLevelEntities(const char* name, std::vector<LevelEntity>& entities)
+    {
+        const std::string path = std::string(DASSET_ROOT) + "/levels/" + name + ".lua";
+
+        lua_State* lua = luaL_newstate();
+        if(luaL_dofile(lua, path.c_str()) != LUA_OK || !lua_istable(lua, -1))
+        {
+            std::fprintf(stderr, "Couldn't load %s\n", path.c_str());
+            lua_close(lua);
+            return false;
+        }
+
+        const int levelTable = lua_gettop(lua);
+        lua_pushnil(lua);
+        while(lua_next(lua, levelTable) != 0)
+        {
+            const int entityTable = lua_gettop(lua);
+            LevelEntity entity = {};
+
+            if(GetComponent(lua, entityTable, "Transform"))
+            {
+                entity.position = GetVector3(lua, -1, "position");
+                entity.rotation = GetVector3(lua, -1, "rotation");
+                lua_pop(lua, 1);
+            }
+            if(GetComponent(lua, entityTable, "Render"))
+            {
+                lua_getfield(lua, -1, "assetName");
+                entity.assetName = lua_tostring(lua, -1) ? lua_tostring(lua, -1) : "";
+                lua_pop(lua, 2);
+            }
+            if(GetComponent(lua, entityTable, "Walkable"))
+            {
+                entity.walkable = true;
+                lua_pop(lua, 1);
+            }
+            if(GetComponent(lua, entityTable, "NavGate"))
+            {
+                entity.navGate = true;
+                entity.allowedGoalMask = GetMask(lua, -1, "allowedGoalIds");
+                lua_pop(lua, 1);
+            }
+            if(GetComponent(lua, entityTable, "EnemyGoal"))
+            {
+                entity.goal = true;
+                entity.goalMask = GetMask(lua, -1, "ids");
+                lua_pop(lua, 1);
+            }
+            if(GetComponent(lua, entityTable, "EnemySpawn"))
+            {
+                entity.spawn = true;
+                entity.spawnId = (uint32_t)GetNumber(lua, -1, "id");
+                entity.goalId = (uint32_t)GetNumber(lua, -1, "goalId");
+                lua_pop(lua, 1);
+            }
+
+            entities.push_back(entity);
+            lua_pop(lua, 1);
+        }
+
+        lua_close(lua);
+        return true;
+    }
+
+    // What GetModelBoundingBox gives for the model, without loading it onto the GPU
+    BoundingBox GetBoundingBox(const std::string& assetName)
+    {
+        static std::map<std::string, BoundingBox> boundingBoxes;
+        if(auto iter = boundingBoxes.find(assetName); iter != boundingBoxes.end())
+            return iter->second;
+
+        const float maxVal = std::numeric_limits<float>::max();
+        BoundingBox box = {
+            .min = {maxVal, maxVal, maxVal},
+            .max = {-maxVal, -maxVal, -maxVal},
+        };
+
+        std::ifstream in(std::string(DASSET_ROOT) + "/ruins/" + assetName + ".obj");
+        std::string line;
+        while(std::getline(in, line))
+        {
+            if(line.rfind("v ", 0) != 0)
+                continue;
+
+            Vector3 vertex;
+            std::istringstream(line.substr(2)) >> vertex.x >> vertex.y >> vertex.z;
+            box.min = Vector3Min(box.min, vertex);
+            box.max = Vector3Max(box.max, vertex);
+        }
+
+        if(box.min.x > box.max.x)
+            box = {.min = Vector3Zero(), .max = Vector3Zero()};
+
+        boundingBoxes[assetName] = box;
+        return box;
+    }
+
+    // Navigation.Build, BuildWalls, BakeWalls and BakeFlowFields, the way navigation_tools.lua
+    // calls them
+    bool LoadLevel(const char* name, ThreadPool& threadPool, Level& level)
+    {
+        std::vector<LevelEntity> entities;
+        if(!LoadLevelEntities(name, entities))
+            return false;
+
+        const float maxVal = std::numeric_limits<float>::max();
+        Vector3 min = {maxVal, 0.0f, maxVal};
+        Vector3 max = {-maxVal, 0.0f, -maxVal};
+
+        std::vector<Navigation::Footprint> footprints;
+        std::map<uint32_t, uint32_t> goalIds;
+        for(const LevelEntity& entity : entities)
+        {
+            if(!entity.walkable && !entity.navGate && !entity.goal && !entity.spawn)
+                continue;
+
+            const Vector2 position = Vector3Flatten(entity.position);
+            if(entity.walkable)
+            {
+                const Vector3 halfTile = {TILE_SIZE, 0.0f, TILE_SIZE};
+                min = Vector3Min(min, Vector3Subtract(entity.position, halfTile));
+                max = Vector3Max(max, Vector3Add(entity.position, halfTile));
+            }
+
+            if(entity.spawn)
+            {
+                goalIds[entity.spawnId] = entity.goalId;
+                level.spawnPositions.push_back(entity.position);
+                level.spawnFieldIds.push_back((entity.spawnId << 16) | entity.goalId);
+            }
+
+            if(entity.assetName.empty())
+                continue;
+
+            const BoundingBox bounds = BoundingBoxTransform(
+                GetBoundingBox(entity.assetName),
+                MatrixRotateZYX(entity.rotation));
+            const Vector2 footprintMin = Vector2Add(position, Vector3Flatten(bounds.min));
+            const Vector2 footprintMax = Vector2Add(position, Vector3Flatten(bounds.max));
+            auto addFootprint = [&](Navigation::Tile::Type type, uint32_t ids) {
+                footprints.push_back(
+                    {.type = type, .ids = ids, .min = footprintMin, .max = footprintMax});
+            };
+
+            if(entity.navGate)
+                addFootprint(Navigation::Tile::NAV_GATE, entity.allowedGoalMask);
+            if(entity.goal)
+                addFootprint(Navigation::Tile::GOAL, entity.goalMask);
+            if(entity.spawn)
+            {
+                addFootprint(
+                    Navigation::Tile::SPAWN,
+                    (entity.spawnId << 16) | (entity.goalId & 0xFFFF));
+            }
+            if(entity.walkable && !entity.goal && !entity.spawn)
+                addFootprint(Navigation::Tile::WALKABLE, 0);
+        }
+
+        if(min.x > max.x || level.spawnPositions.empty())
+        {
+            std::fprintf(stderr, "%s has nothing to walk on or no spawns\n", name);
+            return false;
+        }
+
+        min = Vector3Subtract(min, {1.0f, 0.0f, 1.0f});
+        max = Vector3Add(max, {1.0f, 0.0f, 1.0f});
+        level.navigation =
+            Navigation(Vector3Flatten(min), Vector3Flatten(max), min.x, min.z, TILE_SIZE);
+        level.navigation.Rasterize(std::move(footprints));
+        level.navigation.BuildWalls(threadPool);
+        level.navigation.BakeWalls();
+
+        std::vector<Navigation::FlowFieldPair> pairs;
+        for(auto [spawnId, goalId] : goalIds)
+            pairs.push_back({.spawnId = spawnId, .goalId = goalId});
+        const std::vector<bool> built =
+            level.navigation.BakeFlowFields(pairs, {.smooth = true}, threadPool);
+        for(size_t i = 0; i < pairs.size(); ++i)
+        {
+            if(!built[i])
+                std::fprintf(stderr, "%s: no path from spawn %u\n", name, pairs[i].spawnId);
+        }
+
+        return true;
+    }
+
+    // Like the Spawn function of the level behaviours, but with a small offset so agents aren't
+    // spawned exactly on top of each other
+    void Spawn(entt::registry& registry, const Level& level, std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> offset(-0.25f, 0.25f);
+        for(size_t i = 0; i < level.spawnPositions.size(); ++i)
+        {
+            const entt::entity entity = registry.create();
+            Vector3 position = level.spawnPositions[i];
+            position.x += offset(random);
+            position.z += offset(random);
+            registry.emplace<Component::Transform>(
+                entity,
+                Component::Transform{.position = position, .rotation = Vector3Zero()});
+            registry.emplace<Component::MoveTowards>(
+                entity,
+                Component::MoveTowards{
+                    .vectorFieldId = level.spawnFieldIds[i],
+                    .speed = AGENT_SPEED,
+                    .fieldHandle = {},
+                });
+            registry.emplace<Component::Velocity>(entity, Component::Velocity{0.0f, 0.0f, 0.0f});
+            registry.emplace<Component::Acceleration>(
+                entity,
+                Component::Acceleration{.acceleration = Vector3Zero()});
+            registry.emplace<Component::Health>(entity, Component::Health{.currentHealth = 3.0f});
+            registry.emplace<LastVelocity>(entity, LastVelocity{.velocity = Vector2Zero()});
+        }
+    }
+
+    // lodInterval 1 steers every agent every tick, see System::SteeringLod
+    Result Run(
+        Level& level,
+        System::AvoidanceModel avoidanceModel,
+        uint32_t lodInterval,
+        ThreadPool& threadPool)
+    {
+        entt::registry registry;
+        // There is no camera or tower, so every agent is one that nobody would notice
+        System::SteeringLod lod;
+        std::mt19937 random(1);
+        // GetRandomForce draws from this, both models should get the same numbers
+        mt.seed(1);
+
+        Result result;
+        std::vector<Vector2> positions;
+        uint32_t spawned = 0;
+        for(uint32_t frame = 0; frame < MAX_FRAMES; ++frame)
+        {
+            if(frame % SPAWN_INTERVAL == 0 && spawned < WAVE_SIZE)
+            {
+                Spawn(registry, level, random);
+                ++spawned;
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            lod.Update(registry, lodInterval, 16.0f / 9.0f);
+            System::SteerAgents(
+                registry,
+                level.navigation,
+                KSI,
+                AVOIDANCE_T,
+                OBSTACLE_T,
+                TIME,
+                false,
+                avoidanceModel,
+                lodInterval > 1 ? &lod : nullptr,
+                &threadPool);
+            const auto end = std::chrono::high_resolution_clock::now();
+            result.steeringMs += std::chrono::duration<double, std::milli>(end - start).count();
+            ++result.steeringFrames;
+
+            positions.clear();
+            for(auto [entity, transform, velocity, lastVelocity] :
+                registry.view<Component::Transform, Component::Velocity, LastVelocity>().each())
+            {
+                positions.push_back(Vector3Flatten(transform.position));
+
+                const Vector2 newVelocity = {velocity.x, velocity.z};
+                const float change = Vector2Distance(newVelocity, lastVelocity.velocity);
+                result.velocityChange += change;
+                // As far as CalculateVelocity lets the velocity change in one frame
+                if(change >= 20.0f * TIME * 0.999f)
+                    ++result.cappedChanges;
+                lastVelocity.velocity = newVelocity;
+            }
+            result.agentFrames += positions.size();
+
+            for(size_t i = 0; i < positions.size(); ++i)
+            {
+                for(size_t j = i + 1; j < positions.size(); ++j)
+                {
+                    if(Vector2Distance(positions[i], positions[j]) < OVERLAP_DISTANCE)
+                        ++result.overlappingPairs;
+                }
+            }
+
+            // CheckHealth, every agent that dies has reached the goal
+            size_t alive = 0;
+            for(auto [entity, health] : registry.view<Component::Health>().each())
+            {
+                if(health.currentHealth <= 0.0001f)
+                {
+                    registry.destroy(entity);
+                    ++result.reachedGoal;
+                }
+                else
+                    ++alive;
+            }
+
+            result.frames = frame + 1;
+            if(spawned == WAVE_SIZE && alive == 0)
+                break;
+        }
+
+        return result;
+    }
+
+    // Steers every agent for CHECK_FRAMES with the separate systems, or with SteerAgents if
+    // `fused`, and returns the positions and velocities of every agent afterwards
+    std::vector<float> Simulate(
+        Level& level,
+        System::AvoidanceModel avoidanceModel,
+        bool fused,
+        ThreadPool* threadPool)
+    {
+        entt::registry registry;
+        std::mt19937 random(1);
+        mt.seed(1);
+
+        for(uint32_t frame = 0; frame < CHECK_FRAMES; ++frame)
+        {
+            if(frame % SPAWN_INTERVAL == 0)
+                Spawn(registry, level, random);
+
+            if(fused)
+            {
+                System::SteerAgents(
+                    registry,
+                    level.navigation,
+                    KSI,
+                    AVOIDANCE_T,
+                    OBSTACLE_T,
+                    TIME,
+                    false,
+                    avoidanceModel,
+                    nullptr,
+                    threadPool);
+                continue;
+            }
+
+            // Same order as World::Update
+            System::Navigate(registry, level.navigation, KSI, TIME, false, threadPool);
+            if(avoidanceModel == System::AvoidanceModel::ORCA)
+            {
+                System::AvoidEntitiesOrca(
+                    registry,
+                    level.navigation,
+                    AVOIDANCE_T,
+                    TIME,
+                    threadPool);
+            }
+            else
+            {
+                System::AvoidEntities(
+                    registry,
+                    level.navigation,
+                    KSI,
+                    AVOIDANCE_T,
+                    TIME,
+                    avoidanceModel,
+                    threadPool);
+                System::AvoidObstacles(registry, level.navigation, OBSTACLE_T, TIME, threadPool);
+            }
+            System::CalculateVelocity(registry, TIME);
+            System::MoveEntities(registry, TIME);
+        }
+
+        std::vector<float> state;
+        for(auto [entity, transform, velocity] :
+            registry.view<Component::Transform, Component::Velocity>().each())
+        {
+            state.insert(
+                state.end(),
+                {transform.position.x,
+                 transform.position.y,
+                 transform.position.z,
+                 velocity.x,
+                 velocity.y,
+                 velocity.z});
+        }
+        return state;
+    }
+
+    // Whether steering on the thread pool ends up with exactly the same bits as steering on one
+    // thread, for both the separate systems and SteerAgents
+    bool MatchesSerial(Level& level, System::AvoidanceModel avoidanceModel, ThreadPool& threadPool)
+    {
+        bool matches = true;
+        for(bool fused : {false, true})
+        {
+            const std::vector<float> serial = Simulate(level, avoidanceModel, fused, nullptr);
+            const std::vector<float> parallel =
+                Simulate(level, avoidanceModel, fused, &threadPool);
+            if(serial.size() != parallel.size()
+               || std::memcmp(serial.data(), parallel.data(), serial.size() * sizeof(float)) != 0)
+            {
+                std::printf(
+                    "    %s steering differs on the thread pool\n",
+                    fused ? "fused" : "separate");
+                matches = false;
+            }
+        }
+        return matches;
+    }
+
+    void Print(const char* modelName, const Result& result, uint32_t agentCount)
+    {
+        const double agentFrames = (double)std::max<uint64_t>(result.agentFrames, 1);
+        std::printf(
+            "  %-10s %8.3f %10.3f %11.4f %9.2f%% %6u/%-6u %7u\n",
+            modelName,
+            result.steeringMs / std::max(result.steeringFrames, 1u),
+            (double)result.overlappingPairs / std::max(result.frames, 1u),
+            result.velocityChange / agentFrames,
+            100.0 * (double)result.cappedChanges / agentFrames,
+            result.reachedGoal,
+            agentCount,
+            result.frames);
+    }
+}
+
+int main()
+{
+    ThreadPool threadPool;
+    bool allMatch = true;
+
+    for(const char* levelName : LEVELS)
+    {
+        Level level;
+        if(!LoadLevel(levelName, threadPool, level))
+            return 1;
+
+        const uint32_t agentCount = WAVE_SIZE * (uint32_t)level.spawnPositions.size();
+        std::printf(
+            "%s, %u agents from %zu spawns\n",
+            levelName,
+            agentCount,
+            level.spawnPositions.size());
+        std::printf(
+            "  %-10s %8s %10s %11s %10s %13s %7s\n",
+            "model",
+            "ms/frame",
+            "overlaps",
+            "dv/frame",
+            "capped",
+            "reached",
+            "frames");
+
+        Print("forces", Run(level, System::AvoidanceModel::FORCES, 1, threadPool), agentCount);
+        Print("orca", Run(level, System::AvoidanceModel::ORCA, 1, threadPool), agentCount);
+        Print("density", Run(level, System::AvoidanceModel::DENSITY, 1, threadPool), agentCount);
+        Print("forces lod", Run(level, System::AvoidanceModel::FORCES, 4, threadPool), agentCount);
+        Print("orca lod", Run(level, System::AvoidanceModel::ORCA, 4, threadPool), agentCount);
+
+        std::printf("  parallel against serial\n");
+        const std::pair<const char*, System::AvoidanceModel> models[] = {
+            {"forces", System::AvoidanceModel::FORCES},
+            {"orca", System::AvoidanceModel::ORCA},
+            {"density", System::AvoidanceModel::DENSITY},
+        };
+        for(const auto& [modelName, avoidanceModel] : models)
+        {
+            const bool matches = MatchesSerial(level, avoidanceModel, threadPool);
+            std::printf("  %-10s %s\n", modelName, matches ? "identical" : "DIFFERENT");
+            allMatch = allMatch && matches;
+        }
+    }
+
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+#include "avoidance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define AVOIDANCE_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define AVOIDANCE_SSE2
+#endif
+
+// Whatever the length of the velocity is, the avoidance is never pushed harder than this while
+// already colliding
+constexpr float MAX_COLLIDING_MAGNITUDE = 10.0f;
+constexpr float MAX_AVOIDANCE_MAGNITUDE = 20.0f;
+
+namespace
+{
+    void AddNeighbour(
+        AvoidanceForces& forces,
+        Vector2 position,
+        Vector2 velocity,
+        Vector2 otherPosition,
+        Vector2 otherVelocity,
+        float distance,
+        float radius,
+        float avoidanceT)
+    {
+        if(distance < 1.0f)
+        {
+            forces.separation = Vector2Add(
+                forces.separation,
+                Vector2Scale(Vector2DirectionTo(otherPosition, position), 1.0f / distance));
+        }
+
+        std::optional<float> timeToCollision =
+            TimeToCollisionSphere(position, otherPosition, velocity, otherVelocity, radius);
+        if(!timeToCollision.has_value())
+            return;
+
+        const float t = timeToCollision.value();
+        if(t == 0.0f)
+        {
+            const Vector2 avoidanceForce = Vector2DirectionTo(otherPosition, position);
+            const float magnitude = std::min(Vector2Length(velocity), MAX_COLLIDING_MAGNITUDE);
+            forces.avoidance =
+                Vector2Add(forces.avoidance, Vector2Scale(avoidanceForce, magnitude));
+        }
+        else
+        {
+            const Vector2 avoidanceForce = Vector2Normalize(Vector2Subtract(
+                Vector2Add(position, Vector2Scale(velocity, t)),
+                Vector2Add(otherPosition, Vector2Scale(otherVelocity, t))));
+
+            float magnitude = 0.0f;
+            if(t >= 0.0f && t < avoidanceT)
+                magnitude = (avoidanceT - t) / (t + 0.001f);
+            magnitude = std::min(magnitude, MAX_AVOIDANCE_MAGNITUDE);
+
+            forces.avoidance =
+                Vector2Add(forces.avoidance, Vector2Scale(avoidanceForce, magnitude));
+        }
+    }
+
+#if defined(AVOIDANCE_AVX) || defined(AVOIDANCE_SSE2)
+    // Just enough of a wrapper that the kernel below can be written once for both widths
+    #ifdef AVOIDANCE_AVX
+    using Floats = __m256;
+    constexpr size_t LANES = 8;
+
+    Floats Set(float value)
+    {
+        return _mm256_set1_ps(value);
+    }
+
+    Floats Load(const float* values)
+    {
+        return _mm256_loadu_ps(values);
+    }
+
+    Floats Add(Floats a, Floats b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+
+    Floats Sub(Floats a, Floats b)
+    {
+        return _mm256_sub_ps(a, b);
+    }
+
+    Floats Mul(Floats a, Floats b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+
+    Floats Div(Floats a, Floats b)
+    {
+        return _mm256_div_ps(a, b);
+    }
+
+    Floats Sqrt(Floats a)
+    {
+        return _mm256_sqrt_ps(a);
+    }
+
+    Floats Min(Floats a, Floats b)
+    {
+        return _mm256_min_ps(a, b);
+    }
+
+    Floats Max(Floats a, Floats b)
+    {
+        return _mm256_max_ps(a, b);
+    }
+
+    Floats Less(Floats a, Floats b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+
+    Floats And(Floats a, Floats b)
+    {
+        return _mm256_and_ps(a, b);
+    }
+
+    // ~a & b
+    Floats AndNot(Floats a, Floats b)
+    {
+        return _mm256_andnot_ps(a, b);
+    }
+
+    // a where mask is set, b elsewhere
+    Floats Select(Floats mask, Floats a, Floats b)
+    {
+        return _mm256_blendv_ps(b, a, mask);
+    }
+    #else
+    using Floats = __m128;
+    constexpr size_t LANES = 4;
+
+    Floats Set(float value)
+    {
+        return _mm_set1_ps(value);
+    }
+
+    Floats Load(const float* values)
+    {
+        return _mm_loadu_ps(values);
+    }
+
+    Floats Add(Floats a, Floats b)
+    {
+        return _mm_add_ps(a, b);
+    }
+
+    Floats Sub(Floats a, Floats b)
+    {
+        return _mm_sub_ps(a, b);
+    }
+
+    Floats Mul(Floats a, Floats b)
+    {
+        return _mm_mul_ps(a, b);
+    }
+
+    Floats Div(Floats a, Floats b)
+    {
+        return _mm_div_ps(a, b);
+    }
+
+    Floats Sqrt(Floats a)
+    {
+        return _mm_sqrt_ps(a);
+    }
+
+    Floats Min(Floats a, Floats b)
+    {
+        return _mm_min_ps(a, b);
+    }
+
+    Floats Max(Floats a, Floats b)
+    {
+        return _mm_max_ps(a, b);
+    }
+
+    Floats Less(Floats a, Floats b)
+    {
+        return _mm_cmplt_ps(a, b);
+    }
+
+    Floats And(Floats a, Floats b)
+    {
+        return _mm_and_ps(a, b);
+    }
+
+    // ~a & b
+    Floats AndNot(Floats a, Floats b)
+    {
+        return _mm_andnot_ps(a, b);
+    }
+
+    // a where mask is set, b elsewhere
+    Floats Select(Floats mask, Floats a, Floats b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+    #endif
+
+    float Sum(Floats values)
+    {
+        alignas(32) float lanes[LANES];
+        std::memcpy(lanes, &values, sizeof(values));
+        float sum = 0.0f;
+        for(float lane : lanes)
+            sum += lane;
+        return sum;
+    }
+
+    // 1 / length for every lane, 0 where the length is 0 the same way Vector2Normalize leaves a
+    // zero vector alone
+    Floats InverseLength(Floats x, Floats y)
+    {
+        const Floats zero = Set(0.0f);
+        const Floats length = Sqrt(Add(Mul(x, x), Mul(y, y)));
+        const Floats nonZero = Less(zero, length);
+        return And(nonZero, Div(Set(1.0f), Select(nonZero, length, Set(1.0f))));
+    }
+#endif
+}
+
+std::optional<float> TimeToCollisionSphere(
+    const Vector2 position,
+    const Vector2 otherPosition,
+    const Vector2 velocity,
+    const Vector2 otherVelocity,
+    const float radius)
+{
+    float totalRadius = radius + radius;
+    float radiusSquared = totalRadius * totalRadius;
+
+    float distanceSquared = Vector2DistanceSqr(position, otherPosition);
+    if(distanceSquared < radiusSquared)
+        return 0.0f;
+
+    Vector2 relPos = Vector2Subtract(otherPosition, position);
+    Vector2 relVel = Vector2Subtract(velocity, otherVelocity);
+
+    float a = Vector2DotProduct(relVel, relVel);
+    float b = Vector2DotProduct(relPos, relVel);
+    float c = Vector2DotProduct(relPos, relPos) - radiusSquared;
+
+    float disc = b * b - a * c;
+    if(disc < 0.0f || a <= 0.0f)
+        return std::nullopt;
+
+    float t = (b - std::sqrt(disc)) / a;
+
+    if(t <= 0.0f)
+        return std::nullopt;
+
+    return t;
+}
+
+void NeighbourBatch::Clear()
+{
+    positionX.clear();
+    positionY.clear();
+    velocityX.clear();
+    velocityY.clear();
+    distance.clear();
+}
+
+void NeighbourBatch::Add(Vector2 position, Vector2 velocity, float distance)
+{
+    positionX.push_back(position.x);
+    positionY.push_back(position.y);
+    velocityX.push_back(velocity.x);
+    velocityY.push_back(velocity.y);
+    this->distance.push_back(distance);
+}
+
+size_t NeighbourBatch::Size() const
+{
+    return distance.size();
+}
+
+AvoidanceForces GetAvoidanceForces(
+    const NeighbourBatch& neighbours,
+    Vector2 position,
+    Vector2 velocity,
+    float radius,
+    float avoidanceT)
+{
+    AvoidanceForces forces = {.separation = Vector2Zero(), .avoidance = Vector2Zero()};
+    const size_t count = neighbours.Size();
+    size_t i = 0;
+
+#if defined(AVOIDANCE_AVX) || defined(AVOIDANCE_SSE2)
+    const Floats zero = Set(0.0f);
+    const Floats one = Set(1.0f);
+    const Floats positionX = Set(position.x);
+    const Floats positionY = Set(position.y);
+    const Floats velocityX = Set(velocity.x);
+    const Floats velocityY = Set(velocity.y);
+    const float totalRadius = radius + radius;
+    const Floats radiusSquared = Set(totalRadius * totalRadius);
+    const Floats collidingMagnitude =
+        Set(std::min(Vector2Length(velocity), MAX_COLLIDING_MAGNITUDE));
+    const Floats lookAhead = Set(avoidanceT);
+
+    Floats separationX = zero;
+    Floats separationY = zero;
+    Floats avoidanceX = zero;
+    Floats avoidanceY = zero;
+    for(; i + LANES <= count; i += LANES)
+    {
+        // From the agent to the neighbour
+        const Floats relX = Sub(Load(&neighbours.positionX[i]), positionX);
+        const Floats relY = Sub(Load(&neighbours.positionY[i]), positionY);
+        const Floats otherVelocityX = Load(&neighbours.velocityX[i]);
+        const Floats otherVelocityY = Load(&neighbours.velocityY[i]);
+        const Floats distance = Load(&neighbours.distance[i]);
+
+        // Away from the neighbour, used by separation and by neighbours that already overlap
+        const Floats inverseRelLength = InverseLength(relX, relY);
+        const Floats awayX = Mul(Sub(zero, relX), inverseRelLength);
+        const Floats awayY = Mul(Sub(zero, relY), inverseRelLength);
+
+        const Floats close = Less(distance, one);
+        const Floats inverseDistance = Div(one, Select(close, distance, one));
+        separationX = Add(separationX, And(close, Mul(awayX, inverseDistance)));
+        separationY = Add(separationY, And(close, Mul(awayY, inverseDistance)));
+
+        // Same as TimeToCollisionSphere
+        const Floats distanceSquared = Add(Mul(relX, relX), Mul(relY, relY));
+        const Floats overlapping = Less(distanceSquared, radiusSquared);
+        const Floats relVelX = Sub(velocityX, otherVelocityX);
+        const Floats relVelY = Sub(velocityY, otherVelocityY);
+        const Floats a = Add(Mul(relVelX, relVelX), Mul(relVelY, relVelY));
+        const Floats b = Add(Mul(relX, relVelX), Mul(relY, relVelY));
+        const Floats c = Sub(distanceSquared, radiusSquared);
+        const Floats disc = Sub(Mul(b, b), Mul(a, c));
+        const Floats movingCloser = AndNot(Less(disc, zero), Less(zero, a));
+        const Floats t = Div(Sub(b, Sqrt(Max(disc, zero))), Select(movingCloser, a, one));
+        const Floats colliding = AndNot(overlapping, And(Less(zero, t), movingCloser));
+
+        // Away from where the two will be at the time of the collision
+        const Floats futureX = Sub(Mul(relVelX, t), relX);
+        const Floats futureY = Sub(Mul(relVelY, t), relY);
+        const Floats inverseFutureLength = InverseLength(futureX, futureY);
+        const Floats magnitude = And(
+            Less(t, lookAhead),
+            Min(Div(Sub(lookAhead, t), Add(t, Set(0.001f))), Set(MAX_AVOIDANCE_MAGNITUDE)));
+        const Floats futureScale = Mul(inverseFutureLength, magnitude);
+
+        avoidanceX = Add(avoidanceX, And(overlapping, Mul(awayX, collidingMagnitude)));
+        avoidanceY = Add(avoidanceY, And(overlapping, Mul(awayY, collidingMagnitude)));
+        avoidanceX = Add(avoidanceX, And(colliding, Mul(futureX, futureScale)));
+        avoidanceY = Add(avoidanceY, And(colliding, Mul(futureY, futureScale)));
+    }
+
+    forces.separation = {.x = Sum(separationX), .y = Sum(separationY)};
+    forces.avoidance = {.x = Sum(avoidanceX), .y = Sum(avoidanceY)};
+#endif
+
+    for(; i < count; ++i)
+    {
+        AddNeighbour(
+            forces,
+            position,
+            velocity,
+            {.x = neighbours.positionX[i], .y = neighbours.positionY[i]},
+            {.x = neighbours.velocityX[i], .y = neighbours.velocityY[i]},
+            neighbours.distance[i],
+            radius,
+            avoidanceT);
+    }
+
+    return forces;
+}
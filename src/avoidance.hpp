@@ -0,0 +1,52 @@
+#pragma once
+
+#include <external/raylib.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// The per-neighbour part of System::AvoidEntities, split out so it can be done several neighbours
+// at a time
+
+// Time until two spheres with the same radius, moving at constant velocities, touch. 0 if they
+// already overlap and nothing if they never will
+std::optional<float> TimeToCollisionSphere(
+    const Vector2 position,
+    const Vector2 otherPosition,
+    const Vector2 velocity,
+    const Vector2 otherVelocity,
+    const float radius);
+
+// The neighbours of one agent, as a structure of arrays so that several neighbours can be loaded
+// into one register
+struct NeighbourBatch
+{
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> velocityX;
+    std::vector<float> velocityY;
+    // Distance to the agent in 3D, the rest is on the xz-plane
+    std::vector<float> distance;
+
+    void Clear();
+    void Add(Vector2 position, Vector2 velocity, float distance);
+    size_t Size() const;
+};
+
+struct AvoidanceForces
+{
+    // Away from every neighbour closer than one unit, stronger the closer it is
+    Vector2 separation;
+    // Away from predicted collisions. Not yet scaled by the force scale factor
+    Vector2 avoidance;
+};
+
+// Sum of what every neighbour contributes, the same as going through them one by one with
+// TimeToCollisionSphere. Done 8 neighbours at a time with AVX, 4 with SSE2
+AvoidanceForces GetAvoidanceForces(
+    const NeighbourBatch& neighbours,
+    Vector2 position,
+    Vector2 velocity,
+    float radius,
+    float avoidanceT);
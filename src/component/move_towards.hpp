@@ -1,12 +1,15 @@
 #pragma once
 
 #include <external/raylib.hpp>
+#include <navigation.hpp>
 
 namespace Component
 {
     struct MoveTowards
     {
+        // Only used to look up fieldHandle, which is what navigation actually uses
         uint32_t vectorFieldId;
         float speed;
+        Navigation::FieldHandle fieldHandle;
     };
 }
\ No newline at end of file
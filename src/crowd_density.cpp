@@ -0,0 +1,157 @@
+#include "crowd_density.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void CrowdDensity::Build(
+    const Navigation& navigation,
+    std::span<const Vector2> positions,
+    std::span<const Vector2> velocities)
+{
+    assert(positions.size() == velocities.size());
+
+    sizeX = navigation.GetSizeX();
+    sizeY = navigation.GetSizeY();
+    const size_t tileCount = (size_t)sizeX * sizeY;
+    densities.assign(tileCount, 0.0f);
+    this->velocities.assign(tileCount, Vector2Zero());
+    if(tileCount == 0)
+        return;
+
+    // Tile (x, y) is centered on x * tileSize + offsetX, see Navigation::GetTileSpace
+    offsetX = navigation.offsetX;
+    offsetY = navigation.offsetY;
+    inverseTileSize = 1.0f / navigation.tileSize;
+
+    if(reachable.size() != tileCount || reachableGeneration != navigation.generation
+       || reachableTileVersion != navigation.tileVersion)
+    {
+        reachable.resize(tileCount);
+        for(uint32_t y = 0; y < sizeY; ++y)
+        {
+            for(uint32_t x = 0; x < sizeX; ++x)
+                reachable[navigation.GetIndex(x, y)] = navigation.IsReachable(x, y);
+        }
+        reachableGeneration = navigation.generation;
+        reachableTileVersion = navigation.tileVersion;
+    }
+
+    for(size_t i = 0; i < positions.size(); ++i)
+    {
+        const Corners corners = GetCorners(positions[i]);
+        for(int corner = 0; corner < 4; ++corner)
+        {
+            const int64_t x = corners.x + (corner & 1);
+            const int64_t y = corners.y + (corner >> 1);
+            if(!IsOnGrid(x, y))
+                continue;
+
+            const size_t index = (size_t)y * sizeX + (size_t)x;
+            densities[index] += corners.weights[corner];
+            this->velocities[index] = Vector2Add(
+                this->velocities[index],
+                Vector2Scale(velocities[i], corners.weights[corner]));
+        }
+    }
+}
+
+CrowdDensity::Sample CrowdDensity::GetSample(Vector2 position, Vector2 velocity) const
+{
+    const Corners corners = GetCorners(position);
+
+    // The agent was splatted with the same weights it is sampled with, so taking those back out
+    // leaves everyone else
+    float cornerDensities[4];
+    Vector2 cornerVelocities[4];
+    bool cornerReachable[4];
+    float reachableDensity = 0.0f;
+    int reachableCount = 0;
+    for(int corner = 0; corner < 4; ++corner)
+    {
+        const int64_t x = corners.x + (corner & 1);
+        const int64_t y = corners.y + (corner >> 1);
+        cornerDensities[corner] = 0.0f;
+        cornerVelocities[corner] = Vector2Zero();
+        cornerReachable[corner] = IsOnGrid(x, y) && reachable[(size_t)y * sizeX + (size_t)x];
+        if(!cornerReachable[corner])
+            continue;
+
+        const size_t index = (size_t)y * sizeX + (size_t)x;
+        const float weight = corners.weights[corner];
+        cornerDensities[corner] = std::max(densities[index] - weight, 0.0f);
+        cornerVelocities[corner] =
+            Vector2Subtract(velocities[index], Vector2Scale(velocity, weight));
+        reachableDensity += cornerDensities[corner];
+        ++reachableCount;
+    }
+
+    if(reachableCount == 0)
+        return {.density = 0.0f, .gradient = Vector2Zero(), .velocity = Vector2Zero()};
+
+    // Walls are as crowded as the floor next to them, otherwise the gradient would point away
+    // from every wall and push the agents next to one into it
+    reachableDensity /= (float)reachableCount;
+    for(int corner = 0; corner < 4; ++corner)
+    {
+        if(!cornerReachable[corner])
+            cornerDensities[corner] = reachableDensity;
+    }
+
+    float density = 0.0f;
+    Vector2 velocitySum = Vector2Zero();
+    for(int corner = 0; corner < 4; ++corner)
+    {
+        density += cornerDensities[corner] * corners.weights[corner];
+        velocitySum = Vector2Add(
+            velocitySum,
+            Vector2Scale(cornerVelocities[corner], corners.weights[corner]));
+    }
+
+    // Derivative of the bilinear interpolation, in tiles
+    const float fx = corners.fractionX;
+    const float fy = corners.fractionY;
+    const Vector2 tileGradient = {
+        .x = (1.0f - fy) * (cornerDensities[1] - cornerDensities[0])
+             + fy * (cornerDensities[3] - cornerDensities[2]),
+        .y = (1.0f - fx) * (cornerDensities[2] - cornerDensities[0])
+             + fx * (cornerDensities[3] - cornerDensities[1]),
+    };
+
+    // Splatted densities are agents per tile
+    const float inverseTileArea = inverseTileSize * inverseTileSize;
+    return {
+        .density = density * inverseTileArea,
+        .gradient = Vector2Scale(tileGradient, inverseTileArea * inverseTileSize),
+        .velocity = density > 0.001f ? Vector2Scale(velocitySum, 1.0f / density) : Vector2Zero(),
+    };
+}
+
+CrowdDensity::Corners CrowdDensity::GetCorners(Vector2 position) const
+{
+    const float tileX = (position.x - offsetX) * inverseTileSize;
+    const float tileY = (position.y - offsetY) * inverseTileSize;
+    const float floorX = std::floor(tileX);
+    const float floorY = std::floor(tileY);
+    const float fx = tileX - floorX;
+    const float fy = tileY - floorY;
+    return {
+        .x = (int64_t)floorX,
+        .y = (int64_t)floorY,
+        .fractionX = fx,
+        .fractionY = fy,
+        .weights =
+            {
+                (1.0f - fx) * (1.0f - fy),
+                fx * (1.0f - fy),
+                (1.0f - fx) * fy,
+                fx * fy,
+            },
+    };
+}
+
+bool CrowdDensity::IsOnGrid(int64_t x, int64_t y) const
+{
+    // Negative values wrap around and fail the comparison as well
+    return (uint64_t)x < sizeX && (uint64_t)y < sizeY;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <external/raylib.hpp>
+#include <navigation.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// How crowded it is around every navigation tile and which way the crowd there is moving, in the
+// style of continuum crowds, https://grail.cs.washington.edu/projects/crowd-flows/. Every agent
+// is splatted onto the four closest tile centres, so building costs one pass over the agents and
+// one over the tiles no matter how tightly the agents are packed. Rebuilt from scratch with
+// Build, which is cheap enough to do every frame.
+//
+// Used by AvoidanceModel::DENSITY instead of looking at every neighbour
+class CrowdDensity
+{
+  public:
+    struct Sample
+    {
+        // Agents per square unit
+        float density;
+        // Towards where it is more crowded, in agents per square unit per unit
+        Vector2 gradient;
+        // Average velocity of the agents around, zero if there are none
+        Vector2 velocity;
+    };
+
+    // Replaces the grid with the agents, positions[i] moves with velocities[i]. The grid has the
+    // same tiles as `navigation`
+    void Build(
+        const Navigation& navigation,
+        std::span<const Vector2> positions,
+        std::span<const Vector2> velocities);
+
+    // The crowd around an agent that was part of Build, with the agent itself left out. Tiles
+    // that can't be walked on count as being as crowded as the tiles around them, so nothing is
+    // pushed into a wall. Safe to call from several threads at once
+    Sample GetSample(Vector2 position, Vector2 velocity) const;
+
+  private:
+    float offsetX = 0.0f;
+    float offsetY = 0.0f;
+    float inverseTileSize = 1.0f;
+    uint32_t sizeX = 0;
+    uint32_t sizeY = 0;
+    // Same layout as Navigation::TileData::tiles. Weighted sum of the agents splatted onto every
+    // tile and of their velocities
+    std::vector<float> densities;
+    std::vector<Vector2> velocities;
+    // Whether the tile can be walked on at all, only updated when the tiles change
+    std::vector<uint8_t> reachable;
+    uint32_t reachableGeneration = 0;
+    uint64_t reachableTileVersion = 0;
+
+    struct Corners
+    {
+        // Tile of the corner with the lowest coordinates
+        int64_t x;
+        int64_t y;
+        // How far between that tile and the next the position is, [0; 1)
+        float fractionX;
+        float fractionY;
+        // Bilinear weight of every corner, (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1)
+        float weights[4];
+    };
+    Corners GetCorners(Vector2 position) const;
+    bool IsOnGrid(int64_t x, int64_t y) const;
+};
@@ -1,6 +1,8 @@
 #include "lua_world_impl.hpp"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <optional>
 #include <lua_impl/lua_register.hpp>
 #include <lua_impl/lua_register_types.hpp>
 
@@ -35,41 +37,217 @@ namespace LuaRegister
     template<>
     constexpr auto LuaSetFunc<Navigation::Tile> = [](lua_State* lua, Navigation::Tile tile) {
         lua_createtable(lua, 0, 0);
-        lua_pushinteger(lua, (int)tile.type);
+        lua_pushinteger(lua, (int)tile.GetType());
         lua_setfield(lua, -2, "type");
-        switch(tile.type)
+    };
+
+    template<>
+    constexpr auto GetDefault<Navigation::Tile> = Navigation::Tile{.bits = Navigation::Tile::NONE};
+
+    template<>
+    constexpr auto LuaSetFunc<const Navigation::WalkerTile*> =
+        [](lua_State* lua, const Navigation::WalkerTile* walker) {
+            if(!walker)
+            {
+                lua_pushnil(lua);
+                return;
+            }
+
+            lua_createtable(lua, 0, 0);
+            lua_pushinteger(lua, walker->id);
+            lua_setfield(lua, -2, "id");
+            lua_pushinteger(lua, walker->wallId);
+            lua_setfield(lua, -2, "wallId");
+            lua_pushinteger(lua, walker->distance);
+            lua_setfield(lua, -2, "distance");
+            lua_pushinteger(lua, walker->distanceToUnpassable);
+            lua_setfield(lua, -2, "distanceToUnpassable");
+            lua_pushinteger(lua, (int)walker->parentDirection);
+            lua_setfield(lua, -2, "parentDirection");
+            lua_pushboolean(lua, walker->locked);
+            lua_setfield(lua, -2, "locked");
+        };
+}
+
+// The id data for a tile lives next to the grid rather than inside the tile, so it is pushed
+// separately from LuaSetFunc<Navigation::Tile>. Expects the tile table on top of the stack
+static void PushTileIds(lua_State* lua, const Navigation::Tile tile, uint32_t ids)
+{
+    auto pushGoalIds = [&](const char* name) {
+        lua_createtable(lua, 0, 0);
+        int luaIndex = 1;
+        for(uint32_t i = 0; i < Navigation::MAX_GOAL_ID; ++i)
         {
-            case Navigation::Tile::NONE: break;
-            case Navigation::Tile::WALKABLE: break;
-            case Navigation::Tile::SPAWN:
-                lua_pushinteger(lua, tile.spawn.id);
-                lua_setfield(lua, -2, "id");
-                lua_pushinteger(lua, tile.spawn.goalId);
-                lua_setfield(lua, -2, "goalId");
-                break;
-            case Navigation::Tile::GOAL:
-                lua_createtable(lua, 0, 0);
-                for(int i = 0; i < tile.goal.numberOfIds; ++i)
-                {
-                    lua_pushinteger(lua, tile.goal.ids[i]);
-                    lua_rawseti(lua, -2, i + 1);
-                }
-                lua_setfield(lua, -2, "ids");
-                break;
-            case Navigation::Tile::NAV_GATE:
-                lua_createtable(lua, 0, 0);
-                for(int i = 0; i < tile.navGate.numberOfGoalIds; ++i)
-                {
-                    lua_pushinteger(lua, tile.navGate.allowedGoalIds[i]);
-                    lua_rawseti(lua, -2, i + 1);
-                }
-                lua_setfield(lua, -2, "allowedGoalIds");
-                break;
+            if((ids & (1u << i)) == 0)
+                continue;
+
+            lua_pushinteger(lua, i);
+            lua_rawseti(lua, -2, luaIndex++);
         }
+        lua_setfield(lua, -2, name);
     };
 
-    template<>
-    constexpr auto GetDefault<Navigation::Tile> = Navigation::Tile{.type = Navigation::Tile::NONE};
+    switch(tile.GetType())
+    {
+        case Navigation::Tile::NONE: break;
+        case Navigation::Tile::WALKABLE: break;
+        case Navigation::Tile::SPAWN:
+            lua_pushinteger(lua, ids >> 16);
+            lua_setfield(lua, -2, "id");
+            lua_pushinteger(lua, ids & 0xFFFF);
+            lua_setfield(lua, -2, "goalId");
+            break;
+        case Navigation::Tile::GOAL: pushGoalIds("ids"); break;
+        case Navigation::Tile::NAV_GATE: pushGoalIds("allowedGoalIds"); break;
+    }
+}
+
+// Pushes an array of positions
+static void PushPath(lua_State* lua, const std::vector<Vector2>& path)
+{
+    lua_createtable(lua, (int)path.size(), 0);
+    for(size_t i = 0; i < path.size(); ++i)
+    {
+        LuaRegister::LuaSetFunc<Vector2>(lua, path[i]);
+        lua_rawseti(lua, -2, (lua_Integer)i + 1);
+    }
+}
+
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const auto* bytes = (const uint8_t*)data;
+    for(size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+// Hash of everything Navigation.Build reads from the registry plus the build settings, used to
+// tell whether or not a navigation cache is stale
+static uint64_t HashNavigationContent(float tileSize, bool smooth, bool hierarchical)
+{
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+    entt::registry& registry = *World::state.registry;
+
+    // The entity hashes are summed so that the order the entities are visited in doesn't matter
+    uint64_t entitySum = 0;
+    auto addEntity = [&](entt::entity entity, uint8_t type, const void* data, size_t size) {
+        uint64_t hash = HashBytes(FNV_OFFSET, &type, sizeof(type));
+        hash = HashBytes(hash, data, size);
+        if(auto transform = registry.try_get<Component::Transform>(entity); transform)
+            hash = HashBytes(hash, transform, sizeof(*transform));
+        if(auto render = registry.try_get<Component::Render>(entity); render)
+            hash = HashBytes(hash, &render->boundingBox, sizeof(render->boundingBox));
+        // Hashing once more spreads the bits before they are added together
+        entitySum += HashBytes(FNV_OFFSET, &hash, sizeof(hash));
+    };
+
+    for(auto entity : registry.view<Component::Walkable>())
+        addEntity(entity, 0, nullptr, 0);
+    for(auto [entity, navGate] : registry.view<Component::NavGate>().each())
+    {
+        const auto& ids = navGate.allowedGoalIds;
+        addEntity(entity, 1, ids.data(), ids.size() * sizeof(ids[0]));
+    }
+    for(auto [entity, spawn] : registry.view<Component::EnemySpawn>().each())
+        addEntity(entity, 2, &spawn, sizeof(spawn));
+    for(auto [entity, goal] : registry.view<Component::EnemyGoal>().each())
+        addEntity(entity, 3, goal.ids.data(), goal.ids.size() * sizeof(goal.ids[0]));
+
+    uint64_t hash = HashBytes(FNV_OFFSET, &entitySum, sizeof(entitySum));
+    hash = HashBytes(hash, &tileSize, sizeof(tileSize));
+    hash = HashBytes(hash, &smooth, sizeof(smooth));
+    return HashBytes(hash, &hierarchical, sizeof(hierarchical));
+}
+
+// Area of the grid under an entity, taken from the bounding box of its model. Nothing if it has
+// no model
+static std::optional<std::pair<Vector2, Vector2>> GetFootprintArea(
+    entt::registry& registry,
+    entt::entity entity,
+    const Component::Transform& transform)
+{
+    const auto render = registry.try_get<Component::Render>(entity);
+    if(!render)
+        return std::nullopt;
+
+    const Vector2 position = {transform.position.x, transform.position.z};
+    auto bounds = BoundingBoxTransform(render->boundingBox, MatrixRotateZYX(transform.rotation));
+    return std::pair{
+        Vector2Add(position, {.x = bounds.min.x, .y = bounds.min.z}),
+        Vector2Add(position, {.x = bounds.max.x, .y = bounds.max.z}),
+    };
+}
+
+// Adds what the entity stamps onto the grid to footprints, see Navigation::Rasterize
+static void AddFootprints(
+    entt::registry& registry,
+    entt::entity entity,
+    const Component::Transform& transform,
+    std::vector<Navigation::Footprint>& footprints)
+{
+    const auto walkable = registry.try_get<Component::Walkable>(entity);
+    const auto navGate = registry.try_get<Component::NavGate>(entity);
+    const auto goal = registry.try_get<Component::EnemyGoal>(entity);
+    const auto spawn = registry.try_get<Component::EnemySpawn>(entity);
+    if(!walkable && !navGate && !goal && !spawn)
+        return;
+
+    const auto area = GetFootprintArea(registry, entity, transform);
+    if(!area)
+        return;
+
+    auto addFootprint = [&](Navigation::Tile::Type type, uint32_t ids) {
+        footprints.push_back({.type = type, .ids = ids, .min = area->first, .max = area->second});
+    };
+    auto toMask = [](const std::vector<uint32_t>& ids) {
+        uint32_t mask = 0;
+        for(auto id : ids)
+        {
+            if(id < Navigation::MAX_GOAL_ID)
+                mask |= 1u << id;
+        }
+        return mask;
+    };
+
+    // Without a single valid id nothing is stamped, same as the old SetNavGate and SetGoal
+    // passes. A goal stays off the grid since it isn't walkable either
+    const uint32_t navGateMask = navGate ? toMask(navGate->allowedGoalIds) : 0;
+    const uint32_t goalMask = goal ? toMask(goal->ids) : 0;
+    if(navGateMask != 0)
+        addFootprint(Navigation::Tile::NAV_GATE, navGateMask);
+    if(goalMask != 0)
+        addFootprint(Navigation::Tile::GOAL, goalMask);
+    if(spawn)
+    {
+        addFootprint(
+            Navigation::Tile::SPAWN,
+            ((uint32_t)spawn->id << 16) | ((uint32_t)spawn->goalId & 0xFFFF));
+    }
+    if(walkable && !goal && !spawn)
+        addFootprint(Navigation::Tile::WALKABLE, 0);
+}
+
+// Copies the size of the grid to the Lua Navigation table, the editor's tools read it from there
+static void PushNavigationSize(lua_State* lua)
+{
+    lua_getglobal(lua, "Navigation");
+    lua_pushstring(lua, "sizeX");
+    lua_pushinteger(lua, World::state.navigation.GetSizeX());
+    lua_settable(lua, -3);
+    lua_pushstring(lua, "sizeY");
+    lua_pushinteger(lua, World::state.navigation.GetSizeY());
+    lua_settable(lua, -3);
+    lua_pushstring(lua, "tileSize");
+    lua_pushnumber(lua, World::state.navigation.tileSize);
+    lua_settable(lua, -3);
+    lua_pushstring(lua, "offsetX");
+    lua_pushnumber(lua, World::state.navigation.offsetX);
+    lua_settable(lua, -3);
+    lua_pushstring(lua, "offsetY");
+    lua_pushnumber(lua, World::state.navigation.offsetY);
+    lua_settable(lua, -3);
+    lua_pop(lua, 1);
 }
 
 namespace LuaWorld
@@ -88,10 +266,14 @@ namespace LuaWorld
                 Vector3 min{maxVal, 0.0f, maxVal};
                 Vector3 max{minVal, 0.0f, minVal};
 
-                bool anythingAdded = false;
-                World::state.registry->view<Component::Walkable, Component::Transform>().each(
-                    [&](Component::Transform transform) {
-                        anythingAdded = true;
+                // Everything is collected in one pass over the registry and stamped afterwards,
+                // see Navigation::Rasterize
+                std::vector<Navigation::Footprint> footprints;
+                entt::registry& registry = *World::state.registry;
+                for(auto [entity, transform] : registry.view<Component::Transform>().each())
+                {
+                    if(registry.all_of<Component::Walkable>(entity))
+                    {
                         min = Vector3Min(
                             min,
                             {.x = transform.position.x - tileSize,
@@ -102,9 +284,12 @@ namespace LuaWorld
                             {.x = transform.position.x + tileSize,
                              .y = 0.0f,
                              .z = transform.position.z + tileSize});
-                    });
+                    }
+
+                    AddFootprints(registry, entity, transform, footprints);
+                }
 
-                if(!anythingAdded)
+                if(min.x > max.x)
                     return;
 
                 min = Vector3Subtract(min, {1.0f, 0.0f, 1.0f});
@@ -116,120 +301,9 @@ namespace LuaWorld
                     min.x,
                     min.z,
                     tileSize == 0.0f ? 1.0f : tileSize);
+                World::state.navigation.Rasterize(std::move(footprints));
 
-                World::state.registry
-                    ->view<Component::Walkable, Component::Render, Component::Transform>()
-                    .each([&](entt::entity entity,
-                              Component::Render render,
-                              Component::Transform transform) {
-                        auto bounds = BoundingBoxTransform(
-                            render.boundingBox,
-                            MatrixRotateZYX(transform.rotation));
-                        Vector2 minBounds = {.x = bounds.min.x, .y = bounds.min.z};
-                        Vector2 maxBounds = {.x = bounds.max.x, .y = bounds.max.z};
-
-                        Vector2 min =
-                            Vector2Add({transform.position.x, transform.position.z}, minBounds);
-                        Vector2 max =
-                            Vector2Add({transform.position.x, transform.position.z}, maxBounds);
-
-                        if(auto goal = World::state.registry->try_get<Component::EnemyGoal>(entity);
-                           goal)
-                        {
-                            for(auto id : goal->ids)
-                                World::state.navigation.SetGoal(id, min, max);
-                        }
-                        else if(auto spawn =
-                                    World::state.registry->try_get<Component::EnemySpawn>(entity);
-                                spawn)
-                        {
-                            World::state.navigation.SetSpawn(spawn->id, spawn->goalId, min, max);
-                        }
-                        else
-                        {
-                            World::state.navigation.SetWalkable(min, max);
-                        }
-                    });
-
-                World::state.registry
-                    ->view<Component::NavGate, Component::Render, Component::Transform>()
-                    .each([&](entt::entity entity,
-                              Component::NavGate navGate,
-                              Component::Render render,
-                              Component::Transform transform) {
-                        auto bounds = BoundingBoxTransform(
-                            render.boundingBox,
-                            MatrixRotateZYX(transform.rotation));
-                        Vector2 minBounds = {.x = bounds.min.x, .y = bounds.min.z};
-                        Vector2 maxBounds = {.x = bounds.max.x, .y = bounds.max.z};
-
-                        Vector2 min =
-                            Vector2Add({transform.position.x, transform.position.z}, minBounds);
-                        Vector2 max =
-                            Vector2Add({transform.position.x, transform.position.z}, maxBounds);
-
-                        for(uint32_t i = 0; i < navGate.allowedGoalIds.size(); ++i)
-                            World::state.navigation.SetNavGate(navGate.allowedGoalIds[i], min, max);
-                    });
-
-                World::state.registry
-                    ->view<Component::EnemyGoal, Component::Render, Component::Transform>()
-                    .each([&](entt::entity entity,
-                              Component::EnemyGoal goal,
-                              Component::Render render,
-                              Component::Transform transform) {
-                        auto bounds = BoundingBoxTransform(
-                            render.boundingBox,
-                            MatrixRotateZYX(transform.rotation));
-                        Vector2 minBounds = {.x = bounds.min.x, .y = bounds.min.z};
-                        Vector2 maxBounds = {.x = bounds.max.x, .y = bounds.max.z};
-
-                        Vector2 min =
-                            Vector2Add({transform.position.x, transform.position.z}, minBounds);
-                        Vector2 max =
-                            Vector2Add({transform.position.x, transform.position.z}, maxBounds);
-
-                        for(auto id : goal.ids)
-                            World::state.navigation.SetGoal(id, min, max);
-                    });
-
-                World::state.registry
-                    ->view<Component::EnemySpawn, Component::Render, Component::Transform>()
-                    .each([&](entt::entity entity,
-                              Component::EnemySpawn spawn,
-                              Component::Render render,
-                              Component::Transform transform) {
-                        auto bounds = BoundingBoxTransform(
-                            render.boundingBox,
-                            MatrixRotateZYX(transform.rotation));
-                        Vector2 minBounds = {.x = bounds.min.x, .y = bounds.min.z};
-                        Vector2 maxBounds = {.x = bounds.max.x, .y = bounds.max.z};
-
-                        Vector2 min =
-                            Vector2Add({transform.position.x, transform.position.z}, minBounds);
-                        Vector2 max =
-                            Vector2Add({transform.position.x, transform.position.z}, maxBounds);
-
-                        World::state.navigation.SetSpawn(spawn.id, spawn.goalId, min, max);
-                    });
-
-                lua_getglobal(lua, "Navigation");
-                lua_pushstring(lua, "sizeX");
-                lua_pushinteger(lua, World::state.navigation.GetSizeX());
-                lua_settable(lua, -3);
-                lua_pushstring(lua, "sizeY");
-                lua_pushinteger(lua, World::state.navigation.GetSizeY());
-                lua_settable(lua, -3);
-                lua_pushstring(lua, "tileSize");
-                lua_pushnumber(lua, World::state.navigation.tileSize);
-                lua_settable(lua, -3);
-                lua_pushstring(lua, "offsetX");
-                lua_pushnumber(lua, World::state.navigation.offsetX);
-                lua_settable(lua, -3);
-                lua_pushstring(lua, "offsetY");
-                lua_pushnumber(lua, World::state.navigation.offsetY);
-                lua_settable(lua, -3);
-                lua_pop(lua, 1);
+                PushNavigationSize(lua);
 
                 // lua_pcall(lua, 0, 0, 0);
 
@@ -291,6 +365,7 @@ namespace LuaWorld
                         lua_pushinteger(lua, x);
                         lua_pushinteger(lua, y);
                         LuaRegister::LuaSetFunc<Navigation::Tile>(lua, tile);
+                        PushTileIds(lua, tile, World::state.navigation.GetIds(x, y));
                         if(lua_pcall(lua, 3, 0, 0) != LUA_OK)
                         {
                             std::cerr << lua_tostring(lua, -1) << std::endl;
@@ -347,9 +422,15 @@ namespace LuaWorld
                 auto sizeX = luaL_len(lua, -1);
                 lua_pop(lua, 1);
 
-                std::vector<std::vector<Vector2>> vectorField(
-                    sizeY,
-                    std::vector<Vector2>(sizeX, {.x = 0.0f, .y = 0.0f}));
+                if(sizeX != World::state.navigation.GetSizeX()
+                   || sizeY != World::state.navigation.GetSizeY())
+                {
+                    std::cerr << "Vector field size does not match the navigation grid"
+                              << std::endl;
+                    return;
+                }
+
+                std::vector<Vector2> vectorField(sizeX * sizeY, {.x = 0.0f, .y = 0.0f});
                 for(uint32_t y = 0; y < sizeY; ++y)
                 {
                     lua_geti(lua, table.stackIndex, y + 1);
@@ -358,7 +439,7 @@ namespace LuaWorld
                         lua_geti(lua, -1, x + 1);
                         lua_getfield(lua, -1, "x");
                         lua_getfield(lua, -2, "y");
-                        vectorField[y][x] = {
+                        vectorField[y * sizeX + x] = {
                             .x = (float)lua_tonumber(lua, -2),
                             .y = (float)lua_tonumber(lua, -1),
                         };
@@ -371,6 +452,289 @@ namespace LuaWorld
                 World::state.navigation.SetVectorField(fieldId, std::move(vectorField));
             });
 
+        LuaRegister::PushRegister(
+            lua,
+            "BuildFlowFields",
+            +[](lua_State* lua, int spawnId, int goalId, bool smooth, bool hierarchical) {
+                return World::state.navigation.BuildFlowFields(
+                    spawnId,
+                    goalId,
+                    {.smooth = smooth, .hierarchical = hierarchical});
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "BakeFlowFields",
+            +[](lua_State* lua,
+                LuaRegister::Placeholder configs,
+                bool smooth,
+                bool hierarchical) {
+                // configs is a table of spawnId -> goalId
+                std::vector<Navigation::FlowFieldPair> pairs;
+                lua_pushnil(lua);
+                while(lua_next(lua, configs.stackIndex) != 0)
+                {
+                    pairs.push_back({
+                        .spawnId = (uint32_t)lua_tointeger(lua, -2),
+                        .goalId = (uint32_t)lua_tointeger(lua, -1),
+                    });
+                    lua_pop(lua, 1);
+                }
+
+                std::vector<bool> built = World::state.navigation.BakeFlowFields(
+                    pairs,
+                    {.smooth = smooth, .hierarchical = hierarchical},
+                    World::state.threadPool);
+
+                // Returns a table of spawnId -> whether or not the field was built
+                lua_createtable(lua, 0, (int)pairs.size());
+                for(size_t i = 0; i < pairs.size(); ++i)
+                {
+                    lua_pushboolean(lua, built[i]);
+                    lua_rawseti(lua, -2, pairs[i].spawnId);
+                }
+
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "GetWalkerTile",
+            +[](lua_State* lua, int32_t fieldId, int x, int y) {
+                if(x < 0 || y < 0)
+                    return (const Navigation::WalkerTile*)nullptr;
+
+                return World::state.navigation.GetWalkerTile(fieldId, x, y);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "GetDistancesToUnpassable",
+            +[](lua_State* lua, int spawnId, int goalId) {
+                std::vector<int32_t> distances;
+                World::state.navigation.GetDistancesToUnpassable(spawnId, goalId, distances);
+
+                // Returns a flat array where tile (x, y) is at y * sizeX + x + 1
+                lua_createtable(lua, (int)distances.size(), 0);
+                for(size_t i = 0; i < distances.size(); ++i)
+                {
+                    lua_pushinteger(lua, distances[i]);
+                    lua_rawseti(lua, -2, (lua_Integer)i + 1);
+                }
+
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "Raycast",
+            +[](lua_State* lua, Vector2 from, Vector2 to) {
+                const Navigation::RaycastHit hit = World::state.navigation.Raycast(from, to);
+
+                lua_createtable(lua, 0, 3);
+                lua_pushboolean(lua, hit.hit);
+                lua_setfield(lua, -2, "hit");
+                LuaRegister::LuaSetFunc<Vector2>(lua, hit.position);
+                lua_setfield(lua, -2, "position");
+                lua_pushnumber(lua, hit.fraction);
+                lua_setfield(lua, -2, "fraction");
+
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "HasLineOfSight",
+            +[](lua_State* lua, Vector2 from, Vector2 to) {
+                return World::state.navigation.HasLineOfSight(from, to);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "HasLineOfSightBatch",
+            +[](lua_State* lua, Vector2 from, LuaRegister::Placeholder targets) {
+                // targets is an array of positions, returns an array of booleans in the same order
+                std::vector<Vector2> positions(lua_rawlen(lua, targets.stackIndex));
+                for(size_t i = 0; i < positions.size(); ++i)
+                {
+                    lua_rawgeti(lua, targets.stackIndex, (lua_Integer)i + 1);
+                    positions[i] = LuaRegister::LuaGetFunc<Vector2>(lua, lua_gettop(lua));
+                    lua_pop(lua, 1);
+                }
+
+                std::vector<bool> visible;
+                World::state.navigation.HasLineOfSight(from, positions, visible);
+
+                lua_createtable(lua, (int)visible.size(), 0);
+                for(size_t i = 0; i < visible.size(); ++i)
+                {
+                    lua_pushboolean(lua, visible[i]);
+                    lua_rawseti(lua, -2, (lua_Integer)i + 1);
+                }
+
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "FindPath",
+            +[](lua_State* lua, Vector2 from, Vector2 to, int goalId) {
+                // Returns an array of positions from `from` to `to`, or nil if there is no path.
+                // Nav gates and goals only let through the goal id they allow, -1 keeps out of all
+                // of them
+                std::vector<Vector2> path;
+                if(!World::state.pathService
+                        .FindPath(World::state.navigation, from, to, (uint32_t)goalId, path))
+                {
+                    lua_pushnil(lua);
+                    return LuaRegister::Placeholder{};
+                }
+
+                PushPath(lua, path);
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "RequestPath",
+            +[](lua_State* lua, Vector2 from, Vector2 to, int goalId) {
+                // The path is found over the next few frames, see GetPath
+                return (int)World::state.pathService.Request(from, to, (uint32_t)goalId);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "GetPath",
+            +[](lua_State* lua, int id) {
+                // Returns the path once it has been found, false if there is no path and nil while
+                // it is still pending
+                const auto requestId = (PathService::RequestId)id;
+                switch(World::state.pathService.GetStatus(requestId))
+                {
+                    case PathService::Status::FOUND:
+                        PushPath(lua, *World::state.pathService.GetPath(requestId));
+                        break;
+                    case PathService::Status::NO_PATH: lua_pushboolean(lua, false); break;
+                    default: lua_pushnil(lua); break;
+                }
+                return LuaRegister::Placeholder{};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "ReleasePath",
+            +[](lua_State* lua, int id) {
+                World::state.pathService.Release((PathService::RequestId)id);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "SetWalkable",
+            +[](lua_State* lua, Vector2 min, Vector2 max) {
+                World::state.navigation.SetWalkable(min, max);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "SetNavGate",
+            +[](lua_State* lua, int allowedGoalId, Vector2 min, Vector2 max) {
+                if(allowedGoalId < 0 || allowedGoalId >= (int)Navigation::MAX_GOAL_ID)
+                    return;
+
+                World::state.navigation.SetNavGate(allowedGoalId, min, max);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "SetBlocked",
+            +[](lua_State* lua, Vector2 min, Vector2 max) {
+                World::state.navigation.SetBlocked(min, max);
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "GetFootprint",
+            +[](lua_State* lua, lua_Integer entity) -> LuaRegister::Placeholder {
+                // Returns { min, max } or nil if the entity doesn't cover any area
+                entt::registry& registry = *World::state.registry;
+                const auto transform = registry.try_get<Component::Transform>((entt::entity)entity);
+                const auto area =
+                    transform ? GetFootprintArea(registry, (entt::entity)entity, *transform)
+                              : std::nullopt;
+                if(!area)
+                {
+                    lua_pushnil(lua);
+                    return {};
+                }
+
+                lua_createtable(lua, 0, 2);
+                LuaRegister::LuaSetFunc<Vector2>(lua, area->first);
+                lua_setfield(lua, -2, "min");
+                LuaRegister::LuaSetFunc<Vector2>(lua, area->second);
+                lua_setfield(lua, -2, "max");
+                return {};
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "Restamp",
+            +[](lua_State* lua, Vector2 min, Vector2 max) {
+                // Clears the area and stamps everything that is still on it again, the same way
+                // Build does. Footprints are cut off at the edge of the area so the tiles around
+                // it are left alone. Call RepairFlowFields afterwards
+                std::vector<Navigation::Footprint> footprints;
+                entt::registry& registry = *World::state.registry;
+                for(auto [entity, transform] : registry.view<Component::Transform>().each())
+                    AddFootprints(registry, entity, transform, footprints);
+
+                std::erase_if(footprints, [&](Navigation::Footprint& footprint) {
+                    footprint.min.x = std::max(footprint.min.x, min.x);
+                    footprint.min.y = std::max(footprint.min.y, min.y);
+                    footprint.max.x = std::min(footprint.max.x, max.x);
+                    footprint.max.y = std::min(footprint.max.y, max.y);
+                    return footprint.min.x >= footprint.max.x || footprint.min.y >= footprint.max.y;
+                });
+
+                World::state.navigation.SetBlocked(min, max);
+                World::state.navigation.Rasterize(std::move(footprints));
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "RepairFlowFields",
+            +[](lua_State* lua) { World::state.navigation.RepairFlowFields(); });
+
+        LuaRegister::PushRegister(
+            lua,
+            "SaveCache",
+            +[](lua_State* lua, const char* path, float tileSize, bool smooth, bool hierarchical) {
+                return World::state.navigation.SaveCache(
+                    path,
+                    HashNavigationContent(tileSize, smooth, hierarchical));
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "LoadCache",
+            +[](lua_State* lua, const char* path, float tileSize, bool smooth, bool hierarchical) {
+                const bool loaded = World::state.navigation.LoadCache(
+                    path,
+                    HashNavigationContent(tileSize, smooth, hierarchical));
+                if(loaded)
+                    PushNavigationSize(lua);
+                return loaded;
+            });
+
+        LuaRegister::PushRegister(
+            lua,
+            "BuildWalls",
+            +[](lua_State* lua) { World::state.navigation.BuildWalls(World::state.threadPool); });
+
+        LuaRegister::PushRegister(
+            lua,
+            "BakeWalls",
+            +[](lua_State* lua) { World::state.navigation.BakeWalls(); });
+
         LuaRegister::PushRegister(
             lua,
             "SetWall",
@@ -395,12 +759,30 @@ namespace LuaWorld
         lua_pushstring(lua, "ksi");
         lua_pushnumber(lua, 6.0f);
         lua_settable(lua, -3);
+        // "forces", "orca" or "density", see System::AvoidanceModel
+        lua_pushstring(lua, "avoidanceModel");
+        lua_pushstring(lua, "forces");
+        lua_settable(lua, -3);
         lua_pushstring(lua, "avoidanceLookAhead");
         lua_pushnumber(lua, 3.0f);
         lua_settable(lua, -3);
         lua_pushstring(lua, "obstacleLookAhead");
         lua_pushnumber(lua, 2.0f);
         lua_settable(lua, -3);
+        lua_pushstring(lua, "interpolateForces");
+        lua_pushboolean(lua, false);
+        lua_settable(lua, -3);
+        lua_pushstring(lua, "parallelSteering");
+        lua_pushboolean(lua, false);
+        lua_settable(lua, -3);
+        lua_pushstring(lua, "fusedSteering");
+        lua_pushboolean(lua, true);
+        lua_settable(lua, -3);
+        // Agents that nobody would notice steer every this many ticks, see System::SteeringLod.
+        // Only with fusedSteering
+        lua_pushstring(lua, "steeringLodInterval");
+        lua_pushinteger(lua, 4);
+        lua_settable(lua, -3);
 
         lua_setglobal(lua, "Navigation");
 
@@ -538,6 +538,8 @@ int main()
     }
 #endif
 
+    // GPU resources have to go before the context does
+    World::state.navigationDebugDraw.Unload();
     RaylibImGui::Deinit();
     CloseWindow();
 
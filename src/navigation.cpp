@@ -1,10 +1,35 @@
 #include "navigation.hpp"
+#include "navigation_sector_field.hpp"
+#include "thread_pool.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <external/raylib.hpp>
 #include <limits>
 
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define NAVIGATION_SSE2
+#endif
+
+static uint32_t generationCounter = 0;
+
+// Bit N is set if the tile is passable for goal id N, bit MAX_GOAL_ID if it is passable without a
+// goal
+static uint64_t GetPassableGoals(Navigation::Tile tile, uint32_t ids)
+{
+    constexpr uint64_t ALL_GOALS = (2ull << Navigation::MAX_GOAL_ID) - 1;
+    switch(tile.GetType())
+    {
+        case Navigation::Tile::WALKABLE: return ALL_GOALS;
+        // Spawns used to only be passable for their own spawn id, which is why IsPassable takes one
+        case Navigation::Tile::SPAWN: return ALL_GOALS;
+        case Navigation::Tile::NAV_GATE:
+        case Navigation::Tile::GOAL: return ids;
+        default: return 0;
+    }
+}
+
 Navigation::Navigation() {}
 
 Navigation::Navigation(Vector2 min, Vector2 max, float offsetX, float offsetY, float tileSize)
@@ -16,31 +41,179 @@ Navigation::Navigation(Vector2 min, Vector2 max, float offsetX, float offsetY, f
     assert(max.x >= min.x);
     assert(max.y >= min.y);
 
+    // If size is 5, [0; 5] are all valid positions
+    const auto sizeX = (uint32_t)((max.x - min.x) / tileSize);
+    const auto sizeY = (uint32_t)((max.y - min.y) / tileSize);
     tileData = {
-        .tiles = {},
+        .sizeX = sizeX,
+        .sizeY = sizeY,
+        .tiles = std::vector<Tile>((size_t)sizeX * sizeY, Tile{.bits = Tile::NONE}),
+        .ids = std::vector<uint32_t>((size_t)sizeX * sizeY, 0),
         .vectorFields = {},
+        .fieldIndices = {},
     };
+    // Every tile starts out as NONE, which isn't passable for anything
+    tileData.passableRowWords = (sizeX + 63) / 64;
+    tileData.passable.assign(
+        (size_t)(MAX_GOAL_ID + 1) * sizeY * tileData.passableRowWords,
+        0);
+    generation = NextGeneration();
+}
 
-    // If size is 5, [0; 5] are all valid positions
-    tileData.tiles.resize(
-        (max.y - min.y) / tileSize,
-        std::vector<Tile>(
-            (max.x - min.x) / tileSize,
-            Tile{.type = Tile::NONE, .wallSides = (int32_t)Tile::Side::NONE}));
+uint32_t Navigation::NextGeneration()
+{
+    return ++generationCounter;
+}
+
+Navigation::FieldHandle Navigation::ResolveField(int32_t fieldId)
+{
+    auto [iter, inserted] =
+        tileData.fieldIndices.try_emplace(fieldId, (uint32_t)tileData.vectorFields.size());
+    // Reserve an empty slot so the handle stays valid once the field is built
+    if(inserted)
+        tileData.vectorFields.emplace_back();
+
+    return {.index = iter->second, .generation = generation, .fieldId = fieldId};
+}
+
+bool Navigation::IsHandleValid(FieldHandle handle, int32_t fieldId) const
+{
+    return handle.generation == generation && handle.fieldId == fieldId
+           && handle.index < tileData.vectorFields.size();
 }
 
 Vector2 Navigation::GetForce(int32_t fieldId, Vector2 position) const
 {
+    auto iter = tileData.fieldIndices.find(fieldId);
+    if(iter == tileData.fieldIndices.end())
+        return Vector2Zero();
+
+    return GetForce(
+        {.index = iter->second, .generation = generation, .fieldId = fieldId},
+        position);
+}
+
+Vector2 Navigation::GetForce(FieldHandle handle, Vector2 position) const
+{
+    assert(handle.index < tileData.vectorFields.size());
+
     auto [x, y] = GetTileSpace(position);
+    if(!IsValid((int64_t)x, (int64_t)y))
+        return Vector2Zero();
+
+    const VectorField& field = tileData.vectorFields[handle.index];
+    if(field.sectors)
+        return field.sectors->GetForce(*this, (uint32_t)x, (uint32_t)y);
+    if(field.vectors.empty())
+        return Vector2Zero();
 
-    if(IsValid((int64_t)x, (int64_t)y))
+    return field.GetForce((uint32_t)x, (uint32_t)y);
+}
+
+void Navigation::GetForces(
+    int32_t fieldId,
+    std::span<const Vector2> positions,
+    std::span<Vector2> forces,
+    bool interpolate) const
+{
+    auto iter = tileData.fieldIndices.find(fieldId);
+    if(iter == tileData.fieldIndices.end())
+    {
+        std::fill(forces.begin(), forces.end(), Vector2Zero());
+        return;
+    }
+
+    GetForces(
+        {.index = iter->second, .generation = generation, .fieldId = fieldId},
+        positions,
+        forces,
+        interpolate);
+}
+
+void Navigation::GetForces(
+    FieldHandle handle,
+    std::span<const Vector2> positions,
+    std::span<Vector2> forces,
+    bool interpolate) const
+{
+    assert(handle.index < tileData.vectorFields.size());
+    assert(positions.size() == forces.size());
+
+    const VectorField& field = tileData.vectorFields[handle.index];
+    if(!field.sectors && field.vectors.empty())
+    {
+        std::fill(forces.begin(), forces.end(), Vector2Zero());
+        return;
+    }
+
+    // Tile (x, y) is centered on x * tileSize + offsetX, see GetTileSpace
+    const float scale = 1.0f / tileSize;
+    const uint32_t sizeX = tileData.sizeX;
+    const uint32_t sizeY = tileData.sizeY;
+    auto sample = [&](uint32_t x, uint32_t y) {
+        return field.sectors ? field.sectors->GetForce(*this, x, y) : field.GetForce(x, y);
+    };
+
+    if(interpolate)
     {
-        auto iter = tileData.vectorFields.find(fieldId);
-        if(iter != tileData.vectorFields.end())
-            return iter->second.GetForce((int32_t)x, (int32_t)y);
+        for(size_t i = 0; i < positions.size(); ++i)
+        {
+            const float tileX = (positions[i].x - offsetX) * scale;
+            const float tileY = (positions[i].y - offsetY) * scale;
+            // Same validity as the closest tile lookup, so nothing starts moving off the map
+            if(!IsValid((int64_t)std::round(tileX), (int64_t)std::round(tileY)))
+            {
+                forces[i] = Vector2Zero();
+                continue;
+            }
+
+            const float floorX = std::floor(tileX);
+            const float floorY = std::floor(tileY);
+            const float fractionX = tileX - floorX;
+            const float fractionY = tileY - floorY;
+            // The tile centres around the position, clamped to the map
+            const uint32_t x0 = (uint32_t)std::clamp<int64_t>((int64_t)floorX, 0, sizeX - 1);
+            const uint32_t y0 = (uint32_t)std::clamp<int64_t>((int64_t)floorY, 0, sizeY - 1);
+            const uint32_t x1 = std::min(x0 + 1, sizeX - 1);
+            const uint32_t y1 = std::min(y0 + 1, sizeY - 1);
+
+            const Vector2 top = Vector2Lerp(sample(x0, y0), sample(x1, y0), fractionX);
+            const Vector2 bottom = Vector2Lerp(sample(x0, y1), sample(x1, y1), fractionX);
+            forces[i] = Vector2Normalize(Vector2Lerp(top, bottom, fractionY));
+        }
+        return;
     }
 
-    return Vector2Zero();
+    size_t i = 0;
+#ifdef NAVIGATION_SSE2
+    // Two positions per register. Rounding is done as floor(x + 0.5), which is the same thing as
+    // std::round for everything that ends up on the map. Comparing before truncating takes care
+    // of negative positions
+    const __m128 offset = _mm_setr_ps(offsetX, offsetY, offsetX, offsetY);
+    const __m128 scales = _mm_set1_ps(scale);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 sizes = _mm_setr_ps((float)sizeX, (float)sizeY, (float)sizeX, (float)sizeY);
+    for(; i + 2 <= positions.size(); i += 2)
+    {
+        const __m128 position = _mm_loadu_ps(&positions[i].x);
+        const __m128 tile = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(position, offset), scales), half);
+        const int valid = _mm_movemask_ps(
+            _mm_and_ps(_mm_cmpge_ps(tile, _mm_setzero_ps()), _mm_cmplt_ps(tile, sizes)));
+
+        alignas(16) int32_t tiles[4];
+        _mm_store_si128((__m128i*)tiles, _mm_cvttps_epi32(tile));
+        forces[i] = (valid & 0b0011) == 0b0011 ? sample(tiles[0], tiles[1]) : Vector2Zero();
+        forces[i + 1] = (valid & 0b1100) == 0b1100 ? sample(tiles[2], tiles[3]) : Vector2Zero();
+    }
+#endif
+    for(; i < positions.size(); ++i)
+    {
+        const float tileX = std::floor((positions[i].x - offsetX) * scale + 0.5f);
+        const float tileY = std::floor((positions[i].y - offsetY) * scale + 0.5f);
+        forces[i] = IsValid((int64_t)tileX, (int64_t)tileY)
+                        ? sample((uint32_t)tileX, (uint32_t)tileY)
+                        : Vector2Zero();
+    }
 }
 
 Navigation::Wall Navigation::GetWall(uint32_t tileX, uint32_t tileY, Tile::Side wallSide) const
@@ -92,156 +265,428 @@ Navigation::Wall Navigation::GetWall(uint32_t tileX, uint32_t tileY, Tile::Side
     assert(false && "No you");
 }
 
-uint32_t Navigation::GetSizeX() const
+void Navigation::BakeWalls()
 {
-    if(tileData.tiles.empty())
-        return 0;
+    std::vector<Wall>& segments = tileData.wallSegments;
+    segments.clear();
+
+    constexpr uint32_t NO_SEGMENT = std::numeric_limits<uint32_t>::max();
+    constexpr std::array<Tile::Side, 4> sides = {
+        Tile::Side::TOP,
+        Tile::Side::BOTTOM,
+        Tile::Side::LEFT,
+        Tile::Side::RIGHT,
+    };
+    // The segment along each side of every tile, indexed by tile index * 4 + index into `sides`
+    std::vector<uint32_t> tileSegments(tileData.tiles.size() * sides.size(), NO_SEGMENT);
+
+    auto hasWall = [&](uint32_t x, uint32_t y, Tile::Side side) {
+        return (tileData.tiles[GetIndex(x, y)].GetWallSides() & (int)side) != 0;
+    };
 
-    return tileData.tiles[0].size();
+    for(uint32_t sideIndex = 0; sideIndex < sides.size(); ++sideIndex)
+    {
+        const Tile::Side side = sides[sideIndex];
+        // Top and bottom walls run along x, left and right along y
+        const bool alongX = side == Tile::Side::TOP || side == Tile::Side::BOTTOM;
+        const uint32_t lineCount = alongX ? tileData.sizeY : tileData.sizeX;
+        const uint32_t lineLength = alongX ? tileData.sizeX : tileData.sizeY;
+
+        for(uint32_t line = 0; line < lineCount; ++line)
+        {
+            uint32_t i = 0;
+            while(i < lineLength)
+            {
+                auto tileAt = [&](uint32_t i) {
+                    return alongX ? std::pair{i, line} : std::pair{line, i};
+                };
+
+                if(!hasWall(tileAt(i).first, tileAt(i).second, side))
+                {
+                    ++i;
+                    continue;
+                }
+
+                const auto segmentIndex = (uint32_t)segments.size();
+                const auto [startX, startY] = tileAt(i);
+                for(; i < lineLength && hasWall(tileAt(i).first, tileAt(i).second, side); ++i)
+                {
+                    const auto [x, y] = tileAt(i);
+                    tileSegments[GetIndex(x, y) * sides.size() + sideIndex] = segmentIndex;
+                }
+                const auto [endX, endY] = tileAt(i - 1);
+
+                const Wall first = GetWall(startX, startY, side);
+                segments.push_back({
+                    .start = first.start,
+                    .end = GetWall(endX, endY, side).end,
+                    .normal = first.normal,
+                });
+            }
+        }
+    }
+
+    tileData.wallOffsets.assign(tileData.tiles.size() + 1, 0);
+    tileData.wallIndices.clear();
+    for(size_t tileIndex = 0; tileIndex < tileData.tiles.size(); ++tileIndex)
+    {
+        for(size_t sideIndex = 0; sideIndex < sides.size(); ++sideIndex)
+        {
+            const uint32_t segment = tileSegments[tileIndex * sides.size() + sideIndex];
+            if(segment != NO_SEGMENT)
+                tileData.wallIndices.push_back(segment);
+        }
+        tileData.wallOffsets[tileIndex + 1] = (uint32_t)tileData.wallIndices.size();
+    }
+}
+
+void Navigation::GetWallSegments(Vector2 min, Vector2 max, std::vector<uint32_t>& segments) const
+{
+    segments.clear();
+    if(tileData.wallOffsets.empty())
+        return;
+
+    const TileArea area = GetTileArea(min, max);
+    for(uint32_t y = area.minY; y < area.maxY; ++y)
+    {
+        const uint32_t* offsets = tileData.wallOffsets.data() + GetIndex(area.minX, y);
+        segments.insert(
+            segments.end(),
+            tileData.wallIndices.begin() + offsets[0],
+            tileData.wallIndices.begin() + offsets[area.maxX - area.minX]);
+    }
+
+    // A long wall is along many tiles, only report it once
+    std::sort(segments.begin(), segments.end());
+    segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+}
+
+const Navigation::Wall& Navigation::GetWallSegment(uint32_t index) const
+{
+    assert(index < tileData.wallSegments.size());
+    return tileData.wallSegments[index];
+}
+
+uint32_t Navigation::GetSizeX() const
+{
+    return tileData.sizeX;
 }
 
 uint32_t Navigation::GetSizeY() const
 {
-    return tileData.tiles.size();
+    return tileData.sizeY;
 }
 
 void Navigation::SetWalkable(Vector2 min, Vector2 max)
 {
-    ForArea(min, max, [](Tile& tile) { tile.type = Tile::WALKABLE; });
+    ForArea(min, max, [&](Tile& tile, uint32_t x, uint32_t y) {
+        tile.SetType(Tile::WALKABLE);
+        MarkDirty(x, y);
+    });
+    UpdatePassability(GetTileArea(min, max));
 }
 
 void Navigation::SetGoal(uint32_t id, Vector2 min, Vector2 max)
 {
-    ForArea(min, max, [&](Tile& tile) {
-        assert(tile.goal.numberOfIds < 8);
-        if(tile.goal.numberOfIds == 8)
-            return;
-
-        if(tile.type != Tile::GOAL)
-            tile.goal.numberOfIds = 0;
+    assert(id < MAX_GOAL_ID);
+    if(id >= MAX_GOAL_ID)
+        return;
 
-        for(uint32_t i = 0; i < tile.goal.numberOfIds; ++i)
-        {
-            if(tile.goal.ids[i] == id)
-                return;
-        }
+    ForArea(min, max, [&](Tile& tile, uint32_t x, uint32_t y) {
+        uint32_t& ids = tileData.ids[GetIndex(x, y)];
+        if(tile.GetType() != Tile::GOAL)
+            ids = 0;
 
-        tile.type = Tile::GOAL;
-        tile.goal.ids[tile.goal.numberOfIds++] = id;
+        tile.SetType(Tile::GOAL);
+        ids |= 1u << id;
+        MarkDirty(x, y);
     });
+    UpdatePassability(GetTileArea(min, max));
 }
 
 void Navigation::SetSpawn(uint32_t id, uint32_t goalId, Vector2 min, Vector2 max)
 {
-    ForArea(min, max, [&](Tile& tile) {
-        tile.type = Tile::SPAWN;
-        tile.spawn.id = id;
-        tile.spawn.goalId = goalId;
+    ForArea(min, max, [&](Tile& tile, uint32_t x, uint32_t y) {
+        tile.SetType(Tile::SPAWN);
+        tileData.ids[GetIndex(x, y)] = (id << 16) | (goalId & 0xFFFF);
+        MarkDirty(x, y);
     });
+    UpdatePassability(GetTileArea(min, max));
 }
 
 void Navigation::SetNavGate(uint32_t allowedGoalId, Vector2 min, Vector2 max)
 {
-    ForArea(min, max, [&](Tile& tile) {
-        assert(tile.navGate.numberOfGoalIds < 8);
-        if(tile.navGate.numberOfGoalIds == 8)
-            return;
+    assert(allowedGoalId < MAX_GOAL_ID);
+    if(allowedGoalId >= MAX_GOAL_ID)
+        return;
+
+    ForArea(min, max, [&](Tile& tile, uint32_t x, uint32_t y) {
+        uint32_t& ids = tileData.ids[GetIndex(x, y)];
+        if(tile.GetType() != Tile::NAV_GATE)
+            ids = 0;
+
+        tile.SetType(Tile::NAV_GATE);
+        ids |= 1u << allowedGoalId;
+        MarkDirty(x, y);
+    });
+    UpdatePassability(GetTileArea(min, max));
+}
+
+void Navigation::SetBlocked(Vector2 min, Vector2 max)
+{
+    ForArea(min, max, [&](Tile& tile, uint32_t x, uint32_t y) {
+        tile = {.bits = Tile::NONE};
+        tileData.ids[GetIndex(x, y)] = 0;
+        MarkDirty(x, y);
+    });
+    UpdatePassability(GetTileArea(min, max));
+}
+
+void Navigation::Rasterize(std::vector<Footprint> footprints)
+{
+    auto priority = [](Tile::Type type) {
+        switch(type)
+        {
+            case Tile::NONE: return 0;
+            case Tile::WALKABLE: return 1;
+            case Tile::NAV_GATE: return 2;
+            case Tile::GOAL: return 3;
+            case Tile::SPAWN: return 4;
+        }
+        return 0;
+    };
+    // Stable so that the last of several overlapping spawns still wins
+    std::stable_sort(footprints.begin(), footprints.end(), [&](const auto& a, const auto& b) {
+        return priority(a.type) < priority(b.type);
+    });
 
-        for(uint32_t i = 0; i < tile.navGate.numberOfGoalIds; ++i)
+    for(const Footprint& footprint : footprints)
+    {
+        const TileArea area = GetTileArea(footprint.min, footprint.max);
+        if(area.minX >= area.maxX || area.minY >= area.maxY)
+            continue;
+
+        const bool combineIds = footprint.type == Tile::GOAL || footprint.type == Tile::NAV_GATE;
+        const uint32_t count = area.maxX - area.minX;
+        for(uint32_t y = area.minY; y < area.maxY; ++y)
         {
-            if(tile.navGate.allowedGoalIds[i] == allowedGoalId)
-                return;
+            Tile* tiles = tileData.tiles.data() + GetIndex(area.minX, y);
+            uint32_t* ids = tileData.ids.data() + GetIndex(area.minX, y);
+            if(combineIds)
+            {
+                for(uint32_t i = 0; i < count; ++i)
+                    ids[i] = (tiles[i].GetType() == footprint.type ? ids[i] : 0) | footprint.ids;
+            }
+            else
+            {
+                std::fill(ids, ids + count, footprint.ids);
+            }
+            std::fill(tiles, tiles + count, Tile{.bits = footprint.type});
         }
 
-        if(tile.type != Tile::NAV_GATE)
-            tile.navGate.numberOfGoalIds = 0;
-        tile.type = Tile::NAV_GATE;
-        tile.navGate.allowedGoalIds[tile.navGate.numberOfGoalIds++] = allowedGoalId;
-    });
+        UpdatePassability(area);
+        MarkDirty(area.minX, area.minY);
+        MarkDirty(area.maxX - 1, area.maxY - 1);
+    }
 }
 
 void Navigation::SetWall(uint64_t x, uint64_t y, Tile::Side side)
 {
     if(IsReachable(x, y))
-        tileData.tiles[y][x].wallSides |= (int32_t)side;
+    {
+        tileData.tiles[GetIndex(x, y)].AddWall(side);
+        ++tileVersion;
+    }
 }
 
-void Navigation::SetVectorField(uint32_t fieldId, const std::vector<std::vector<Vector2>>& field)
+void Navigation::SetVectorField(int32_t fieldId, std::vector<Vector2>&& vectors)
 {
-    tileData.vectorFields[fieldId] = VectorField{.vectors = field};
+    assert(vectors.size() == tileData.tiles.size());
+
+    FieldHandle handle = ResolveField(fieldId);
+    tileData.vectorFields[handle.index] = VectorField{
+        .sizeX = tileData.sizeX,
+        .sizeY = tileData.sizeY,
+        .vectors = std::move(vectors),
+    };
+    ++fieldVersion;
 }
 
-void Navigation::SetVectorField(uint32_t fieldId, std::vector<std::vector<Vector2>>&& field)
+void Navigation::BuildWalls(ThreadPool& threadPool)
 {
-    tileData.vectorFields[fieldId] = VectorField{.vectors = std::move(field)};
+    // Wall and type bits share a byte, so the walls go into a copy of the grid while the original
+    // is only read. That way neighbouring rows can be done at the same time
+    constexpr uint32_t ROWS_PER_BAND = 32;
+    const uint32_t bandCount = (tileData.sizeY + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+
+    std::vector<Tile> tiles(tileData.tiles.size());
+    threadPool.ParallelFor(bandCount, [&](size_t band) {
+        const uint32_t minY = (uint32_t)band * ROWS_PER_BAND;
+        const uint32_t maxY = std::min(minY + ROWS_PER_BAND, tileData.sizeY);
+        for(uint32_t y = minY; y < maxY; ++y)
+        {
+            for(uint32_t x = 0; x < tileData.sizeX; ++x)
+                tiles[GetIndex(x, y)] = GetTileWithWalls(x, y);
+        }
+    });
+    tileData.tiles = std::move(tiles);
+    ++tileVersion;
 }
 
-bool Navigation::IsValid(int64_t x, int64_t y) const
+void Navigation::UpdateWalls(TileArea area)
 {
-    if(y < 0 || y >= (int64_t)tileData.tiles.size())
-        return false;
-    if(x < 0 || x >= (int64_t)tileData.tiles[0].size())
-        return false;
+    for(uint32_t y = area.minY; y < area.maxY; ++y)
+    {
+        for(uint32_t x = area.minX; x < area.maxX; ++x)
+            tileData.tiles[GetIndex(x, y)] = GetTileWithWalls(x, y);
+    }
+    ++tileVersion;
+}
 
-    return true;
+Navigation::Tile Navigation::GetTileWithWalls(uint32_t x, uint32_t y) const
+{
+    const std::array<std::pair<Tile::Side, std::array<int64_t, 2>>, 4> neighbours = {{
+        {Tile::Side::TOP, {0, -1}},
+        {Tile::Side::BOTTOM, {0, 1}},
+        {Tile::Side::LEFT, {-1, 0}},
+        {Tile::Side::RIGHT, {1, 0}},
+    }};
+
+    Tile tile = tileData.tiles[GetIndex(x, y)];
+    tile.ClearWalls();
+    if(tile.GetType() == Tile::NONE)
+        return tile;
+
+    for(const auto& [side, offset] : neighbours)
+    {
+        if(!IsReachable((int64_t)x + offset[0], (int64_t)y + offset[1]))
+            tile.AddWall(side);
+    }
+    return tile;
+}
+
+void Navigation::UpdatePassability(TileArea area)
+{
+    const size_t goalStride = (size_t)tileData.sizeY * tileData.passableRowWords;
+    for(uint32_t y = area.minY; y < area.maxY; ++y)
+    {
+        uint64_t* row = tileData.passable.data() + (size_t)y * tileData.passableRowWords;
+        for(uint32_t x = area.minX; x < area.maxX; ++x)
+        {
+            const size_t index = GetIndex(x, y);
+            const uint64_t goals = GetPassableGoals(tileData.tiles[index], tileData.ids[index]);
+            const uint64_t bit = 1ull << (x % 64);
+            for(uint32_t goalId = 0; goalId <= MAX_GOAL_ID; ++goalId)
+            {
+                uint64_t& word = row[goalId * goalStride + x / 64];
+                word = ((goals >> goalId) & 1) != 0 ? word | bit : word & ~bit;
+            }
+        }
+    }
+}
+
+void Navigation::MarkDirty(uint32_t x, uint32_t y)
+{
+    ++tileVersion;
+    if(!dirtyArea)
+    {
+        dirtyArea = {.minX = x, .minY = y, .maxX = x + 1, .maxY = y + 1};
+        return;
+    }
+
+    dirtyArea->minX = std::min(dirtyArea->minX, x);
+    dirtyArea->minY = std::min(dirtyArea->minY, y);
+    dirtyArea->maxX = std::max(dirtyArea->maxX, x + 1);
+    dirtyArea->maxY = std::max(dirtyArea->maxY, y + 1);
+}
+
+uint32_t Navigation::GetIds(uint32_t x, uint32_t y) const
+{
+    return tileData.ids[GetIndex(x, y)];
+}
+
+bool Navigation::IsValid(int64_t x, int64_t y) const
+{
+    // Negative values wrap around and fail the comparison as well
+    return (uint64_t)x < tileData.sizeX && (uint64_t)y < tileData.sizeY;
 }
 
 bool Navigation::IsReachable(int64_t x, int64_t y) const
 {
-    return IsValid(x, y) && tileData.tiles[y][x].type != Tile::NONE;
+    return IsValid(x, y) && tileData.tiles[GetIndex(x, y)].GetType() != Tile::NONE;
 }
 
 bool Navigation::IsWalkable(int64_t x, int64_t y) const
 {
-    return IsValid(x, y) && tileData.tiles[y][x].type == Tile::WALKABLE;
+    return IsValid(x, y) && tileData.tiles[GetIndex(x, y)].GetType() == Tile::WALKABLE;
 }
 
 bool Navigation::IsNavGate(int64_t x, int64_t y) const
 {
-    return IsValid(x, y) && tileData.tiles[y][x].type == Tile::NAV_GATE;
+    return IsValid(x, y) && tileData.tiles[GetIndex(x, y)].GetType() == Tile::NAV_GATE;
 }
 
 bool Navigation::IsSpawn(int64_t x, int64_t y) const
 {
-    return IsValid(x, y) && tileData.tiles[y][x].type == Tile::SPAWN;
+    return IsValid(x, y) && tileData.tiles[GetIndex(x, y)].GetType() == Tile::SPAWN;
 }
 
 bool Navigation::IsGoal(int64_t x, int64_t y) const
 {
-    return IsValid(x, y) && tileData.tiles[y][x].type == Tile::GOAL;
+    return IsValid(x, y) && tileData.tiles[GetIndex(x, y)].GetType() == Tile::GOAL;
 }
 
 bool Navigation::IsPassable(uint32_t spawnId, uint32_t goalId, int64_t x, int64_t y) const
 {
-    if(IsWalkable(x, y))
-        return true;
-
-    if(IsNavGate(x, y))
-    {
-        for(int i = 0; i < tileData.tiles[y][x].navGate.numberOfGoalIds; ++i)
-        {
-            if(tileData.tiles[y][x].navGate.allowedGoalIds[i] == goalId)
-                return true;
-        }
+    if(!IsValid(x, y))
         return false;
-    }
 
-    // if(IsSpawn(x, y))
-    //     return tileData.tiles[y][x].spawn.id == spawnId;
-    if(IsSpawn(x, y))
+    return (GetPassableRow(goalId, (uint32_t)y)[x / 64] >> (x % 64)) & 1;
+}
+
+std::span<const uint64_t> Navigation::GetPassableRow(uint32_t goalId, uint32_t y) const
+{
+    assert(y < tileData.sizeY);
+    const size_t row = (size_t)std::min(goalId, MAX_GOAL_ID) * tileData.sizeY + y;
+    return {tileData.passable.data() + row * tileData.passableRowWords, tileData.passableRowWords};
+}
+
+uint64_t Navigation::GetPassableBits(uint32_t goalId, int64_t x, int64_t y) const
+{
+    if(!IsValid(0, y))
+        return 0;
+
+    const std::span<const uint64_t> row = GetPassableRow(goalId, (uint32_t)y);
+    auto getWord = [&](int64_t word) {
+        return word >= 0 && word < (int64_t)row.size() ? row[word] : 0;
+    };
+
+    // Arithmetic shift, so negative x ends up in the word before the grid
+    const int64_t word = x >> 6;
+    const int64_t shift = x & 63;
+    if(shift == 0)
+        return getWord(word);
+    return (getWord(word) >> shift) | (getWord(word + 1) << (64 - shift));
+}
+
+bool Navigation::IsSpanPassable(uint32_t goalId, int64_t minX, int64_t maxX, int64_t y) const
+{
+    if(minX >= maxX)
         return true;
+    if(!IsValid(minX, y) || !IsValid(maxX - 1, y))
+        return false;
 
-    if(IsGoal(x, y))
+    const std::span<const uint64_t> row = GetPassableRow(goalId, (uint32_t)y);
+    for(int64_t word = minX / 64; word <= (maxX - 1) / 64; ++word)
     {
-        for(int i = 0; i < tileData.tiles[y][x].goal.numberOfIds; ++i)
-        {
-            if(tileData.tiles[y][x].goal.ids[i] == goalId)
-                return true;
-        }
-        return false;
+        const int64_t first = std::max(minX - word * 64, (int64_t)0);
+        const int64_t last = std::min(maxX - word * 64, (int64_t)64);
+        const uint64_t mask = (last == 64 ? ~0ull : (1ull << last) - 1) & (~0ull << first);
+        if((row[word] & mask) != mask)
+            return false;
     }
 
-    return false;
+    return true;
 }
 
 Vector2 Navigation::GetTileSpace(Vector2 position) const
@@ -257,67 +702,36 @@ void Navigation::ConvertToTileSpace(Vector2& min, Vector2& max) const
     max = Vector2Round(Vector2Scale(Vector2Add(max, offset), 1.0f / tileSize));
 }
 
-Vector2 Navigation::ConvertToWorldSpace(uint32_t tileX, uint32_t tileY) const
+Navigation::TileArea Navigation::GetTileArea(Vector2 min, Vector2 max) const
 {
+    ConvertToTileSpace(min, max);
+
+    min = {.x = std::max(min.x, 0.0f), .y = std::max(min.y, 0.0f)};
+    max = {.x = std::max(max.x, 0.0f), .y = std::max(max.y, 0.0f)};
+
+    if(min.x == max.x)
+        max.x += 1.0f;
+    if(min.y == max.y)
+        max.y += 1.0f;
+
+    // Clamp to the grid once instead of checking every tile
     return {
-        .x = (float)tileX * tileSize + offsetX,
-        .y = (float)tileY * tileSize + offsetY,
+        .minX = (uint32_t)std::min(min.x, (float)tileData.sizeX),
+        .minY = (uint32_t)std::min(min.y, (float)tileData.sizeY),
+        .maxX = (uint32_t)std::min(max.x, (float)tileData.sizeX),
+        .maxY = (uint32_t)std::min(max.y, (float)tileData.sizeY),
     };
 }
 
-void Navigation::DrawTiles() const
-{
-    ForEachTile([&](uint32_t x, uint32_t y, const Tile& tile) {
-        tile.ForEachWall([&](Tile::Side side) {
-            Wall wall = GetWall(x, y, side);
-            DrawLine3D(
-                Vector3{wall.start.x, 0.5f, wall.start.y},
-                {wall.end.x, 0.5f, wall.end.y},
-                ORANGE);
-
-            Vector2 center =
-                Vector2Add(wall.start, Vector2Scale(Vector2Subtract(wall.end, wall.start), 0.5f));
-            DrawLine3D(
-                {center.x, 0.5f, center.y},
-                Vector3Add(
-                    {center.x, 0.5f, center.y},
-                    {.x = wall.normal.x, .y = 0.0f, .z = wall.normal.y}),
-                ORANGE);
-        });
-    });
-}
-
-void Navigation::DrawField(int32_t fieldId) const
+Vector2 Navigation::ConvertToWorldSpace(uint32_t tileX, uint32_t tileY) const
 {
-    auto iter = tileData.vectorFields.find(fieldId);
-    if(iter == tileData.vectorFields.end())
-        return;
-
-    const auto& vectorField = iter->second;
-    vectorField.ForEach([&](uint32_t x, uint32_t y, Vector2 direction) {
-        Vector3 start = {
-            .x = (float)x * tileSize + offsetX + tileSize * 0.5f,
-            .y = 0.2f,
-            .z = (float)y * tileSize + offsetY + tileSize * 0.5f};
-        Vector3 end = Vector3Add(
-            start,
-            Vector3Scale({.x = direction.x, .y = 0.0f, .z = direction.y}, tileSize * 0.75f));
-
-        Color color = [&]() {
-            switch(tileData.tiles[y][x].type)
-            {
-                case(Tile::GOAL): return GREEN;
-                case(Tile::SPAWN): return BLUE;
-                default: return RED;
-            }
-        }();
-
-        DrawCube(start, 0.1f, 0.1f, 0.1f, ColorAlpha(color, 0.2f));
-        DrawLine3D(start, end, color);
-    });
+    return {
+        .x = (float)tileX * tileSize + offsetX,
+        .y = (float)tileY * tileSize + offsetY,
+    };
 }
 
 Vector2 Navigation::VectorField::GetForce(uint32_t x, uint32_t y) const
 {
-    return this->vectors[y][x];
+    return this->vectors[(size_t)y * sizeX + x];
 }
\ No newline at end of file
@@ -4,13 +4,19 @@
 #include "raymath.h"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <external/raylib.hpp>
+#include <memory>
+#include <optional>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
+class ThreadPool;
+
 class Navigation
 {
   public:
@@ -20,7 +26,7 @@ class Navigation
 
     struct Tile
     {
-        enum Type
+        enum Type : uint8_t
         {
             NONE = 0,
             WALKABLE,
@@ -28,7 +34,7 @@ class Navigation
             GOAL,
             NAV_GATE,
         };
-        enum class Side
+        enum class Side : uint8_t
         {
             NONE = 0,
             TOP = 1,
@@ -37,41 +43,41 @@ class Navigation
             RIGHT = 1 << 3,
         };
 
-        Type type;
-        // This is where I miss rust enums :(
-        // And, you know, always :'(
-        union
+        // The lower 3 bits hold the Type and the 4 bits above that hold the wall Sides. Any id data
+        // lives in TileData::ids so that walking the grid only ever touches one byte per tile
+        static constexpr uint8_t TYPE_MASK = 0b111;
+        static constexpr uint8_t WALL_SHIFT = 3;
+        uint8_t bits;
+
+        Type GetType() const
         {
-            struct
-            {
-            } none;
-            struct
-            {
-            } walkable;
-            struct
-            {
-                uint32_t id;
-                uint32_t goalId;
-            } spawn;
-            struct
-            {
-                std::array<uint32_t, 8> ids;
-                uint8_t numberOfIds;
-            } goal;
-            struct
-            {
-                // 8 allowed, this wastes so much memory. Could be a uint8_t but
-                // it wouldn't align with everything else that is uint32_t.
-                // Placing a vector in a union is not very fun.
-                std::array<uint32_t, 8> allowedGoalIds;
-                uint8_t numberOfGoalIds;
-            } navGate;
-        };
-        int wallSides;
+            return (Type)(bits & TYPE_MASK);
+        }
+
+        void SetType(Type type)
+        {
+            bits = (uint8_t)((bits & ~TYPE_MASK) | type);
+        }
+
+        int GetWallSides() const
+        {
+            return bits >> WALL_SHIFT;
+        }
+
+        void AddWall(Side side)
+        {
+            bits |= (uint8_t)((int)side << WALL_SHIFT);
+        }
+
+        void ClearWalls()
+        {
+            bits &= TYPE_MASK;
+        }
 
         template<typename Func>
         void ForEachWall(Func func) const
         {
+            const int wallSides = GetWallSides();
             if((wallSides & (int)Side::TOP) != 0)
                 func(Side::TOP);
             if((wallSides & (int)Side::BOTTOM) != 0)
@@ -82,6 +88,10 @@ class Navigation
                 func(Side::RIGHT);
         }
     };
+    static_assert(sizeof(Tile) == 1);
+
+    // Goal ids are stored as bits in a uint32_t, see TileData::ids
+    static constexpr uint32_t MAX_GOAL_ID = 32;
 
     struct Wall
     {
@@ -90,45 +100,165 @@ class Navigation
         Vector2 normal;
     };
 
+    // Per-tile state of the wall-following walkers that built a field, see BuildFlowFields
+    struct WalkerTile
+    {
+        // 0 is reserved for unreachable tiles, -1 for tiles no walker has stepped on
+        int32_t id;
+        // Id of the walker that this walker follows, 0 is the goal's wall
+        int32_t wallId;
+        uint32_t distance;
+        int32_t distanceToUnpassable;
+        // Points towards the tile this one was reached from
+        Tile::Side parentDirection;
+        bool locked;
+    };
+
+    struct FlowFieldOptions
+    {
+        // Average each tile with its neighbours. The only reason to turn this off is for
+        // troubleshooting
+        bool smooth = true;
+        // Build a SectorField instead of walking the whole map, see navigation_sector_field.hpp.
+        // Meant for large maps, the fields are coarser than the walker ones
+        bool hierarchical = false;
+    };
+
+    // Half-open area in tile space, [minX; maxX) x [minY; maxY)
+    struct TileArea
+    {
+        uint32_t minX = 0;
+        uint32_t minY = 0;
+        uint32_t maxX = 0;
+        uint32_t maxY = 0;
+    };
+
+    struct RaycastHit
+    {
+        // False if the ray got all the way to its end without leaving walkable space
+        bool hit;
+        // Where the ray left walkable space, or the end of the ray if it didn't
+        Vector2 position;
+        // How far along the ray `position` is, in [0; 1]
+        float fraction;
+        // The last walkable tile the ray was in and the side it left through. NONE if the ray
+        // didn't hit anything or started outside of walkable space
+        uint32_t tileX;
+        uint32_t tileY;
+        Tile::Side side;
+    };
+
+    // Area in world space covered by something that is placed on the grid, see Rasterize
+    struct Footprint
+    {
+        Tile::Type type;
+        // Same meaning as TileData::ids for the type
+        uint32_t ids;
+        Vector2 min;
+        Vector2 max;
+    };
+
+    struct FlowFieldPair
+    {
+        uint32_t spawnId;
+        uint32_t goalId;
+    };
+
+    class SectorField;
+
     class VectorField
     {
       public:
-        std::vector<std::vector<Vector2>> vectors;
+        uint32_t sizeX = 0;
+        uint32_t sizeY = 0;
+        // Row-major, same layout as TileData::tiles
+        std::vector<Vector2> vectors;
+        // Only set for fields created by BuildFlowFields. Kept around for debugging and so the
+        // field can be repaired when tiles change, see RepairFlowFields
+        std::vector<WalkerTile> walkers;
+        FlowFieldOptions options;
+        // Set instead of `vectors` and `walkers` for hierarchical fields
+        std::shared_ptr<SectorField> sectors;
 
         Vector2 GetForce(uint32_t x, uint32_t y) const;
 
         template<typename Func>
         void ForEach(const Func& func) const
         {
-            for(uint32_t y = 0; y < vectors.size(); ++y)
+            const Vector2* vector = vectors.data();
+            for(uint32_t y = 0; y < sizeY; ++y)
             {
-                for(uint32_t x = 0; x < vectors[y].size(); ++x)
-                    func(x, y, vectors[y][x]);
+                for(uint32_t x = 0; x < sizeX; ++x, ++vector)
+                    func(x, y, *vector);
             }
         }
     };
 
+    // A field id resolved to its slot in TileData::vectorFields. Resolve it once with
+    // ResolveField and keep it around instead of looking the id up every frame. A handle is only
+    // valid for the Navigation instance it was resolved from, see IsHandleValid
+    struct FieldHandle
+    {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        int32_t fieldId = -1;
+    };
+
     // If tiles change, so does the vector field, so keep it in the same struct
     struct TileData
     {
-        std::vector<std::vector<Tile>> tiles;
-        std::unordered_map<int32_t, VectorField> vectorFields;
+        uint32_t sizeX = 0;
+        uint32_t sizeY = 0;
+        // Row-major, tile (x, y) is at index y * sizeX + x
+        std::vector<Tile> tiles;
+        // Side table with the same layout as `tiles`. What the value means depends on the type:
+        // SPAWN: (spawnId << 16) | goalId, same layout as the vector field ids
+        // GOAL: bit N is set if the tile is a goal for goal id N
+        // NAV_GATE: bit N is set if goal id N is allowed to pass through
+        std::vector<uint32_t> ids;
+        // Dense storage indexed by FieldHandle::index. A slot may be empty if a handle was
+        // resolved before its field was built
+        std::vector<VectorField> vectorFields;
+        // Field id -> index into vectorFields
+        std::unordered_map<int32_t, uint32_t> fieldIndices;
+        // Baked by BakeWalls. Walls along the same line on neighbouring tiles are merged into one
+        // segment. The segments along the sides of tile i are
+        // wallIndices[wallOffsets[i]; wallOffsets[i + 1])
+        std::vector<Wall> wallSegments;
+        std::vector<uint32_t> wallOffsets;
+        std::vector<uint32_t> wallIndices;
+        // One bit per tile for every goal id, set where IsPassable is true for that goal. Goal id
+        // MAX_GOAL_ID is for passing without a goal. Every row starts on a new word, see
+        // GetPassableRow
+        uint32_t passableRowWords = 0;
+        std::vector<uint64_t> passable;
     } tileData;
+    // Every Navigation instance gets a unique generation so stale handles can be detected
+    uint32_t generation = 0;
+    // Tiles that have changed since the fields were last built or repaired
+    std::optional<TileArea> dirtyArea;
+    // Bumped whenever a tile changes, walls included, for anything that caches results based on
+    // the tiles
+    uint64_t tileVersion = 0;
+    // Bumped whenever a vector field is built, repaired or replaced
+    uint64_t fieldVersion = 0;
 
     Navigation();
     Navigation(Vector2 min, Vector2 max, float offsetX, float offsetY, float tileSize);
 
+    static uint32_t NextGeneration();
+
     template<typename Func>
     void ForEachTile(const Func& func)
     {
         // Possible use for const_cast?
-        for(uint32_t y = 0; y < tileData.tiles.size(); ++y)
+        Tile* tile = tileData.tiles.data();
+        for(uint32_t y = 0; y < tileData.sizeY; ++y)
         {
-            auto& row = tileData.tiles[y];
-            for(uint32_t x = 0; x < row.size(); ++x)
+            for(uint32_t x = 0; x < tileData.sizeX; ++x, ++tile)
             {
-                if(row[x].type != Tile::NONE)
-                    func(x, y, row[x]);
+                if(tile->GetType() != Tile::NONE)
+                    func(x, y, *tile);
             }
         }
     }
@@ -136,13 +266,13 @@ class Navigation
     template<typename Func>
     void ForEachTile(const Func& func) const
     {
-        for(uint32_t y = 0; y < tileData.tiles.size(); ++y)
+        const Tile* tile = tileData.tiles.data();
+        for(uint32_t y = 0; y < tileData.sizeY; ++y)
         {
-            const auto& row = tileData.tiles[y];
-            for(uint32_t x = 0; x < row.size(); ++x)
+            for(uint32_t x = 0; x < tileData.sizeX; ++x, ++tile)
             {
-                if(row[x].type != Tile::NONE)
-                    func(x, y, row[x]);
+                if(tile->GetType() != Tile::NONE)
+                    func(x, y, *tile);
             }
         }
     }
@@ -150,35 +280,12 @@ class Navigation
     template<typename Func>
     void ForArea(Vector2 min, Vector2 max, const Func& func)
     {
-        ConvertToTileSpace(min, max);
-
-        if(min.x < 0.0f)
-            min.x = 0.0f;
-        if(min.y < 0.0f)
-            min.y = 0.0f;
-        if(max.x < 0.0f)
-            max.x = 0.0f;
-        if(max.y < 0.0f)
-            max.y = 0.0f;
-
-        if(min.x == max.x)
-            max.x += 1.0f;
-        if(min.y == max.y)
-            max.y += 1.0f;
-
-        const auto sizeY = tileData.tiles.size();
-        for(auto y = (uint32_t)min.y; y < (uint32_t)max.y; ++y)
+        const TileArea area = GetTileArea(min, max);
+        for(auto y = area.minY; y < area.maxY; ++y)
         {
-            if(y < 0 || y >= sizeY)
-                continue;
-
-            auto& row = tileData.tiles[y];
-            const auto sizeX = row.size();
-            for(auto x = (uint32_t)min.x; x < (uint32_t)max.x; ++x)
+            Tile* row = tileData.tiles.data() + (size_t)y * tileData.sizeX;
+            for(auto x = area.minX; x < area.maxX; ++x)
             {
-                if(x < 0 || x >= sizeX)
-                    continue;
-
                 if constexpr(requires(Tile tile) { func(tile); })
                 {
                     func(row[x]);
@@ -191,8 +298,45 @@ class Navigation
         }
     }
 
+    FieldHandle ResolveField(int32_t fieldId);
+    bool IsHandleValid(FieldHandle handle, int32_t fieldId) const;
+
     Vector2 GetForce(int32_t fieldId, Vector2 position) const;
+    Vector2 GetForce(FieldHandle handle, Vector2 position) const;
+    // Same as GetForce for many positions in the same field, forces[i] is the force at
+    // positions[i]. With `interpolate` the vectors of the four closest tile centres are blended
+    // instead of using the closest one, which gets rid of the stair-stepping along diagonals
+    void GetForces(
+        int32_t fieldId,
+        std::span<const Vector2> positions,
+        std::span<Vector2> forces,
+        bool interpolate = false) const;
+    void GetForces(
+        FieldHandle handle,
+        std::span<const Vector2> positions,
+        std::span<Vector2> forces,
+        bool interpolate = false) const;
     Wall GetWall(uint32_t tileX, uint32_t tileY, Tile::Side wallSide) const;
+    // Follows the ray tile by tile until it crosses a wall or enters a tile that isn't reachable.
+    // A ray that starts outside of walkable space hits right away
+    RaycastHit Raycast(Vector2 from, Vector2 to) const;
+    void Raycast(
+        std::span<const Vector2> from,
+        std::span<const Vector2> to,
+        std::span<RaycastHit> hits) const;
+    bool HasLineOfSight(Vector2 from, Vector2 to) const;
+    // visible[i] is set to whether or not targets[i] can be seen from `from`
+    void HasLineOfSight(
+        Vector2 from,
+        std::span<const Vector2> targets,
+        std::vector<bool>& visible) const;
+    // Merges the walls of all tiles into segments, see TileData::wallSegments. Has to be called
+    // after the walls are set for GetWallSegments to find anything
+    void BakeWalls();
+    // Fills `segments` with the index of every merged wall segment along a tile in the area, each
+    // index only once
+    void GetWallSegments(Vector2 min, Vector2 max, std::vector<uint32_t>& segments) const;
+    const Wall& GetWallSegment(uint32_t index) const;
     uint32_t GetSizeX() const;
     uint32_t GetSizeY() const;
 
@@ -200,9 +344,56 @@ class Navigation
     void SetGoal(uint32_t id, Vector2 min, Vector2 max);
     void SetSpawn(uint32_t id, uint32_t goalId, Vector2 min, Vector2 max);
     void SetNavGate(uint32_t allowedGoalId, Vector2 min, Vector2 max);
+    // Turns the area back into nothing, for when something is placed on top of the tiles
+    void SetBlocked(Vector2 min, Vector2 max);
+    // Stamps all footprints onto the grid. Where they overlap, spawns win over goals, goals over
+    // nav gates and nav gates over walkable tiles. Overlapping goals or nav gates combine their
+    // ids, for spawns the last one wins. Walls of the stamped tiles are cleared, see BuildWalls.
+    // Only touches the grid, so it can run on any thread as long as nothing else uses the instance
+    void Rasterize(std::vector<Footprint> footprints);
     void SetWall(uint64_t x, uint64_t y, Tile::Side side);
-    void SetVectorField(uint32_t fieldId, const std::vector<std::vector<Vector2>>& field);
-    void SetVectorField(uint32_t fieldId, std::vector<std::vector<Vector2>>&& field);
+    void SetVectorField(int32_t fieldId, std::vector<Vector2>&& vectors);
+
+    // Builds the field (spawnId << 16) | goalId by letting walkers follow walls outwards from the
+    // goal. Returns false if there is no goal tile next to a wall, no field is built in that case
+    bool BuildFlowFields(uint32_t spawnId, uint32_t goalId, FlowFieldOptions options);
+    // Same as BuildFlowFields but for several fields at once, spread over the thread pool. Nothing
+    // is published until every field is done. Returns whether or not each pair was built
+    std::vector<bool> BakeFlowFields(
+        const std::vector<FlowFieldPair>& pairs,
+        FlowFieldOptions options,
+        ThreadPool& threadPool);
+    // Updates walls and every field built by BuildFlowFields/BakeFlowFields to match the tiles
+    // changed since the last build. Only the dirty area and the tiles whose path went through it
+    // are re-routed, the walkers are not run again. Call BakeFlowFields for a full rebuild
+    void RepairFlowFields();
+    static int32_t GetFieldId(uint32_t spawnId, uint32_t goalId);
+    // Writes the grid, the walls and every built field to `path`, tagged with `contentHash`
+    // which should change whenever anything the navigation was built from does. Returns false if
+    // the file couldn't be written
+    bool SaveCache(const char* path, uint64_t contentHash) const;
+    // Replaces this instance with the one saved to `path`. Returns false and leaves this instance
+    // alone if there is no cache, it was saved by an incompatible build or with another
+    // `contentHash`. Field handles resolved before loading go stale
+    bool LoadCache(const char* path, uint64_t contentHash);
+    const WalkerTile* GetWalkerTile(int32_t fieldId, uint32_t x, uint32_t y) const;
+
+    // Sets the walls of every tile on the grid, see UpdateWalls. Rows are split between the threads
+    // of the pool. BakeWalls still has to be called afterwards
+    void BuildWalls(ThreadPool& threadPool);
+    // Adds a wall to every side of a reachable tile in the area that faces an unreachable tile
+    void UpdateWalls(TileArea area);
+    // The tile at x, y with its walls set the way UpdateWalls would set them
+    Tile GetTileWithWalls(uint32_t x, uint32_t y) const;
+    void MarkDirty(uint32_t x, uint32_t y);
+    // Updates TileData::passable from the tiles in the area
+    void UpdatePassability(TileArea area);
+
+    size_t GetIndex(uint32_t x, uint32_t y) const
+    {
+        return (size_t)y * tileData.sizeX + x;
+    }
+    uint32_t GetIds(uint32_t x, uint32_t y) const;
 
     bool IsValid(int64_t x, int64_t y) const;
     bool IsReachable(int64_t x, int64_t y) const;
@@ -212,11 +403,35 @@ class Navigation
     bool IsGoal(int64_t x, int64_t y) const;
 
     bool IsPassable(uint32_t spawnId, uint32_t goalId, int64_t x, int64_t y) const;
+    // Bit i of word w is set if tile (w * 64 + i, y) is passable for the goal. Goal ids past
+    // MAX_GOAL_ID pass without a goal, same as IsPassable
+    std::span<const uint64_t> GetPassableRow(uint32_t goalId, uint32_t y) const;
+    // Bit i is set if tile (x + i, y) is passable for the goal. Tiles off the grid never are
+    uint64_t GetPassableBits(uint32_t goalId, int64_t x, int64_t y) const;
+    // True if every tile in [minX; maxX) on row y is passable for the goal
+    bool IsSpanPassable(uint32_t goalId, int64_t minX, int64_t maxX, int64_t y) const;
+    // Calls func(x) for every tile on row y that is passable for the goal, in order
+    template<typename Func>
+    void ForEachPassable(uint32_t goalId, uint32_t y, const Func& func) const
+    {
+        const std::span<const uint64_t> row = GetPassableRow(goalId, y);
+        for(size_t word = 0; word < row.size(); ++word)
+        {
+            for(uint64_t bits = row[word]; bits != 0; bits &= bits - 1)
+                func((uint32_t)(word * 64 + std::countr_zero(bits)));
+        }
+    }
+    // Fills `distances` with the tile-distance from every tile to the nearest tile that isn't
+    // passable for the pair, diagonal steps included. Unreachable tiles get 0 and reachable tiles
+    // at least 1. Same layout as TileData::tiles
+    void GetDistancesToUnpassable(
+        uint32_t spawnId,
+        uint32_t goalId,
+        std::vector<int32_t>& distances) const;
 
     Vector2 GetTileSpace(Vector2 position) const;
     Vector2 ConvertToWorldSpace(uint32_t tileX, uint32_t tileY) const;
     void ConvertToTileSpace(Vector2& min, Vector2& max) const;
-
-    void DrawTiles() const;
-    void DrawField(int32_t fieldId) const;
+    // The tiles covered by the world space area, clamped to the grid
+    TileArea GetTileArea(Vector2 min, Vector2 max) const;
 };
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "navigation.hpp"
+#include "navigation_sector_field.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <type_traits>
+
+// The cache is a header followed by the arrays of TileData as they are laid out in memory, and
+// then every field. Nothing is converted, so a cache is only meant to be read by the same build on
+// the same machine. Bump CACHE_VERSION whenever anything that is written here changes layout.
+
+namespace
+{
+    constexpr char CACHE_MAGIC[4] = {'N', 'A', 'V', 'C'};
+    constexpr uint32_t CACHE_VERSION = 1;
+
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t contentHash;
+        float offsetX;
+        float offsetY;
+        float tileSize;
+        uint32_t sizeX;
+        uint32_t sizeY;
+        uint32_t fieldCount;
+        uint32_t wallSegmentCount;
+        uint32_t wallIndexCount;
+    };
+
+    struct CacheField
+    {
+        int32_t fieldId;
+        uint8_t smooth;
+        // Hierarchical fields are cheap to set up and build their sectors lazily, so only the
+        // options are stored and the field is built again on load. The others are followed by
+        // their vectors
+        uint8_t hierarchical;
+        // Followed by the walkers as well. Fields set with SetVectorField have none
+        uint8_t hasWalkers;
+        uint8_t padding;
+    };
+
+    static_assert(std::is_trivially_copyable_v<Navigation::Tile>);
+    static_assert(std::is_trivially_copyable_v<Navigation::Wall>);
+    static_assert(std::is_trivially_copyable_v<Navigation::WalkerTile>);
+    static_assert(std::is_trivially_copyable_v<Vector2>);
+
+    // The whole file in one read, empty if it can't be read. Everything in it is copied into the
+    // vectors of TileData anyway, so it isn't worth mapping it
+    std::vector<uint8_t> ReadFile(const char* path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if(!file)
+            return {};
+
+        const std::streamsize size = file.tellg();
+        if(size <= 0)
+            return {};
+
+        std::vector<uint8_t> contents((size_t)size);
+        file.seekg(0);
+        if(!file.read((char*)contents.data(), size))
+            return {};
+        return contents;
+    }
+
+    // Reads consecutive values out of the contents of a file. Every read fails once one has run
+    // past the end
+    class CacheReader
+    {
+      public:
+        explicit CacheReader(std::span<const uint8_t> contents)
+            : data(contents.data())
+            , size(contents.size())
+        {
+        }
+
+        template<typename T>
+        bool Read(T& out)
+        {
+            return ReadBytes(&out, sizeof(T));
+        }
+
+        template<typename T>
+        bool Read(std::vector<T>& out, size_t count)
+        {
+            if(count > (size - offset) / sizeof(T))
+                return false;
+
+            out.resize(count);
+            return ReadBytes(out.data(), count * sizeof(T));
+        }
+
+      private:
+        const uint8_t* data;
+        size_t size;
+        size_t offset = 0;
+
+        bool ReadBytes(void* out, size_t byteCount)
+        {
+            if(!data || byteCount > size - offset)
+                return false;
+
+            std::memcpy(out, data + offset, byteCount);
+            offset += byteCount;
+            return true;
+        }
+    };
+
+    template<typename T>
+    void Write(std::ofstream& file, const T& value)
+    {
+        file.write((const char*)&value, sizeof(T));
+    }
+
+    template<typename T>
+    void Write(std::ofstream& file, const std::vector<T>& values)
+    {
+        file.write((const char*)values.data(), (std::streamsize)(values.size() * sizeof(T)));
+    }
+}
+
+bool Navigation::SaveCache(const char* path, uint64_t contentHash) const
+{
+    const size_t tileCount = tileData.tiles.size();
+    // Written to a temporary file first so a failed save never leaves half a cache behind
+    const std::string tempPath = std::string(path) + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+
+        CacheHeader header = {
+            .version = CACHE_VERSION,
+            .contentHash = contentHash,
+            .offsetX = offsetX,
+            .offsetY = offsetY,
+            .tileSize = tileSize,
+            .sizeX = tileData.sizeX,
+            .sizeY = tileData.sizeY,
+            .fieldCount = 0,
+            .wallSegmentCount = (uint32_t)tileData.wallSegments.size(),
+            .wallIndexCount = (uint32_t)tileData.wallIndices.size(),
+        };
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        // Slots that were resolved but never built are skipped
+        for(const VectorField& field : tileData.vectorFields)
+        {
+            if(field.sectors || field.vectors.size() == tileCount)
+                ++header.fieldCount;
+        }
+
+        Write(file, header);
+        Write(file, tileData.tiles);
+        Write(file, tileData.ids);
+        Write(file, tileData.wallSegments);
+        // Empty if the walls were never baked
+        std::vector<uint32_t> wallOffsets = tileData.wallOffsets;
+        wallOffsets.resize(tileCount + 1, 0);
+        Write(file, wallOffsets);
+        Write(file, tileData.wallIndices);
+
+        for(const auto& [fieldId, index] : tileData.fieldIndices)
+        {
+            const VectorField& field = tileData.vectorFields[index];
+            if(!field.sectors && field.vectors.size() != tileCount)
+                continue;
+
+            Write(
+                file,
+                CacheField{
+                    .fieldId = fieldId,
+                    .smooth = field.options.smooth,
+                    .hierarchical = field.sectors != nullptr,
+                    .hasWalkers = field.walkers.size() == tileCount,
+                });
+            if(field.sectors)
+                continue;
+
+            Write(file, field.vectors);
+            if(field.walkers.size() == tileCount)
+                Write(file, field.walkers);
+        }
+
+        if(!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
+
+bool Navigation::LoadCache(const char* path, uint64_t contentHash)
+{
+    const std::vector<uint8_t> contents = ReadFile(path);
+    CacheReader reader(contents);
+
+    CacheHeader header;
+    if(!reader.Read(header) || std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+       || header.version != CACHE_VERSION || header.contentHash != contentHash
+       || header.tileSize == 0.0f)
+    {
+        return false;
+    }
+
+    // Everything goes into a new instance so that nothing changes unless the whole file is valid
+    Navigation loaded;
+    loaded.offsetX = header.offsetX;
+    loaded.offsetY = header.offsetY;
+    loaded.tileSize = header.tileSize;
+    loaded.generation = NextGeneration();
+
+    TileData& data = loaded.tileData;
+    data.sizeX = header.sizeX;
+    data.sizeY = header.sizeY;
+    const size_t tileCount = (size_t)header.sizeX * header.sizeY;
+    if(!reader.Read(data.tiles, tileCount) || !reader.Read(data.ids, tileCount)
+       || !reader.Read(data.wallSegments, header.wallSegmentCount)
+       || !reader.Read(data.wallOffsets, tileCount + 1)
+       || !reader.Read(data.wallIndices, header.wallIndexCount))
+    {
+        return false;
+    }
+    // Cheap to work out again, so it isn't part of the cache
+    data.passableRowWords = (data.sizeX + 63) / 64;
+    data.passable.assign((size_t)(MAX_GOAL_ID + 1) * data.sizeY * data.passableRowWords, 0);
+    loaded.UpdatePassability({.minX = 0, .minY = 0, .maxX = data.sizeX, .maxY = data.sizeY});
+
+    for(uint32_t i = 0; i < header.fieldCount; ++i)
+    {
+        CacheField cacheField;
+        if(!reader.Read(cacheField))
+            return false;
+
+        const FlowFieldOptions options = {
+            .smooth = cacheField.smooth != 0,
+            .hierarchical = cacheField.hierarchical != 0,
+        };
+        const auto spawnId = (uint32_t)(cacheField.fieldId >> 16);
+        const auto goalId = (uint32_t)(cacheField.fieldId & 0xFFFF);
+
+        VectorField field = {.sizeX = data.sizeX, .sizeY = data.sizeY, .options = options};
+        if(options.hierarchical)
+        {
+            field.sectors = SectorField::Build(loaded, spawnId, goalId);
+            if(!field.sectors)
+                return false;
+        }
+        else if(
+            !reader.Read(field.vectors, tileCount)
+            || (cacheField.hasWalkers && !reader.Read(field.walkers, tileCount)))
+        {
+            return false;
+        }
+
+        const FieldHandle handle = loaded.ResolveField(cacheField.fieldId);
+        data.vectorFields[handle.index] = std::move(field);
+    }
+
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,331 @@
+#include "navigation_debug_draw.hpp"
+#include "navigation_sector_field.hpp"
+
+#include "rlgl.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Meshes can only be drawn as triangles, so lines are flat quads this wide, in tiles
+    constexpr float LINE_WIDTH = 0.05f;
+
+    struct Geometry
+    {
+        std::vector<float> vertices;
+        std::vector<unsigned char> colors;
+
+        void AddVertex(Vector3 position, Color color)
+        {
+            vertices.insert(vertices.end(), {position.x, position.y, position.z});
+            colors.insert(colors.end(), {color.r, color.g, color.b, color.a});
+        }
+
+        void AddQuad(Vector3 a, Vector3 b, Vector3 c, Vector3 d, Color color)
+        {
+            for(const Vector3 corner : {a, b, c, a, c, d})
+                AddVertex(corner, color);
+        }
+
+        // Flat on the xz-plane
+        void AddLine(Vector3 start, Vector3 end, float width, Color color)
+        {
+            const Vector2 direction = {.x = end.x - start.x, .y = end.z - start.z};
+            const float length = Vector2Length(direction);
+            if(length == 0.0f)
+                return;
+
+            const float halfWidth = width * 0.5f / length;
+            const Vector3 side = {
+                .x = -direction.y * halfWidth,
+                .y = 0.0f,
+                .z = direction.x * halfWidth,
+            };
+            AddQuad(
+                Vector3Subtract(start, side),
+                Vector3Subtract(end, side),
+                Vector3Add(end, side),
+                Vector3Add(start, side),
+                color);
+        }
+
+        // Flat on the xz-plane
+        void AddSquare(Vector3 center, float size, Color color)
+        {
+            const float half = size * 0.5f;
+            AddQuad(
+                {.x = center.x - half, .y = center.y, .z = center.z - half},
+                {.x = center.x + half, .y = center.y, .z = center.z - half},
+                {.x = center.x + half, .y = center.y, .z = center.z + half},
+                {.x = center.x - half, .y = center.y, .z = center.z + half},
+                color);
+        }
+    };
+
+    struct ChunkGeometry
+    {
+        BoundingBox bounds;
+        Geometry full;
+        Geometry coarse;
+    };
+
+    class ChunkGrid
+    {
+      public:
+        ChunkGrid(const Navigation& navigation, uint32_t chunkSize)
+            : chunkSize(chunkSize)
+            , chunksX((navigation.GetSizeX() + chunkSize - 1) / chunkSize)
+        {
+            const uint32_t chunksY = (navigation.GetSizeY() + chunkSize - 1) / chunkSize;
+            const float tileSize = navigation.tileSize;
+            // Wall normals stick out a whole unit, whatever the tile size
+            const float margin = std::max(tileSize, 1.0f);
+            const float chunkExtent = (float)chunkSize * tileSize;
+
+            chunks.resize((size_t)chunksX * chunksY);
+            for(uint32_t y = 0; y < chunksY; ++y)
+            {
+                for(uint32_t x = 0; x < chunksX; ++x)
+                {
+                    const float minX = navigation.offsetX + (float)x * chunkExtent;
+                    const float minZ = navigation.offsetY + (float)y * chunkExtent;
+                    chunks[(size_t)y * chunksX + x].bounds = {
+                        .min = {.x = minX - margin, .y = 0.0f, .z = minZ - margin},
+                        .max = {
+                            .x = minX + chunkExtent + margin,
+                            .y = 1.0f,
+                            .z = minZ + chunkExtent + margin},
+                    };
+                }
+            }
+        }
+
+        ChunkGeometry& Get(uint32_t tileX, uint32_t tileY)
+        {
+            return chunks[(size_t)(tileY / chunkSize) * chunksX + tileX / chunkSize];
+        }
+
+        std::vector<ChunkGeometry> chunks;
+
+      private:
+        uint32_t chunkSize;
+        uint32_t chunksX;
+    };
+
+    Mesh Upload(Geometry& geometry)
+    {
+        Mesh mesh = {};
+        if(geometry.vertices.empty())
+            return mesh;
+
+        mesh.vertexCount = (int)(geometry.vertices.size() / 3);
+        mesh.triangleCount = mesh.vertexCount / 3;
+        mesh.vertices = geometry.vertices.data();
+        mesh.colors = geometry.colors.data();
+        UploadMesh(&mesh, false);
+        // Only the GPU copy is used from here on. UnloadMesh would free these otherwise
+        mesh.vertices = nullptr;
+        mesh.colors = nullptr;
+        return mesh;
+    }
+
+    template<typename Chunk>
+    void UploadChunks(std::vector<ChunkGeometry>& geometry, std::vector<Chunk>& chunks)
+    {
+        for(ChunkGeometry& chunk : geometry)
+        {
+            if(chunk.full.vertices.empty())
+                continue;
+
+            chunks.push_back({
+                .bounds = chunk.bounds,
+                .mesh = Upload(chunk.full),
+                .coarseMesh = Upload(chunk.coarse),
+            });
+        }
+    }
+
+    Vector4 ToClipSpace(const Matrix& m, Vector3 v)
+    {
+        return {
+            .x = m.m0 * v.x + m.m4 * v.y + m.m8 * v.z + m.m12,
+            .y = m.m1 * v.x + m.m5 * v.y + m.m9 * v.z + m.m13,
+            .z = m.m2 * v.x + m.m6 * v.y + m.m10 * v.z + m.m14,
+            .w = m.m3 * v.x + m.m7 * v.y + m.m11 * v.z + m.m15,
+        };
+    }
+
+    // Conservative, a box is only outside if all of its corners are outside the same plane
+    bool IsOutsideView(const Matrix& viewProjection, const BoundingBox& box)
+    {
+        int outside[6] = {};
+        for(int i = 0; i < 8; ++i)
+        {
+            const Vector3 corner = {
+                .x = (i & 1) ? box.max.x : box.min.x,
+                .y = (i & 2) ? box.max.y : box.min.y,
+                .z = (i & 4) ? box.max.z : box.min.z,
+            };
+            const Vector4 clip = ToClipSpace(viewProjection, corner);
+            outside[0] += clip.x < -clip.w;
+            outside[1] += clip.x > clip.w;
+            outside[2] += clip.y < -clip.w;
+            outside[3] += clip.y > clip.w;
+            outside[4] += clip.z < -clip.w;
+            outside[5] += clip.z > clip.w;
+        }
+
+        return std::find(std::begin(outside), std::end(outside), 8) != std::end(outside);
+    }
+}
+
+void NavigationDebugDraw::DrawTiles(const Navigation& navigation)
+{
+    const OverlayKey key = {
+        .generation = navigation.generation,
+        .tileVersion = navigation.tileVersion,
+    };
+    if(!tiles.built || tiles.key != key)
+    {
+        ChunkGrid grid(navigation, CHUNK_SIZE);
+        const float lineWidth = LINE_WIDTH * navigation.tileSize;
+        navigation.ForEachTile([&](uint32_t x, uint32_t y, const Navigation::Tile& tile) {
+            Geometry& geometry = grid.Get(x, y).full;
+            tile.ForEachWall([&](Navigation::Tile::Side side) {
+                const Navigation::Wall wall = navigation.GetWall(x, y, side);
+                geometry.AddLine(
+                    {wall.start.x, 0.5f, wall.start.y},
+                    {wall.end.x, 0.5f, wall.end.y},
+                    lineWidth,
+                    ORANGE);
+
+                const Vector2 center = Vector2Lerp(wall.start, wall.end, 0.5f);
+                geometry.AddLine(
+                    {center.x, 0.5f, center.y},
+                    {center.x + wall.normal.x, 0.5f, center.y + wall.normal.y},
+                    lineWidth,
+                    ORANGE);
+            });
+        });
+
+        Clear(tiles);
+        UploadChunks(grid.chunks, tiles.chunks);
+        tiles.key = key;
+        tiles.built = true;
+    }
+
+    Draw(tiles, navigation.tileSize);
+}
+
+void NavigationDebugDraw::DrawField(const Navigation& navigation, int32_t fieldId)
+{
+    auto iter = navigation.tileData.fieldIndices.find(fieldId);
+    if(iter == navigation.tileData.fieldIndices.end())
+        return;
+
+    const Navigation::VectorField& vectorField = navigation.tileData.vectorFields[iter->second];
+    const OverlayKey key = {
+        .generation = navigation.generation,
+        .tileVersion = navigation.tileVersion,
+        .fieldVersion = navigation.fieldVersion,
+        .fieldId = fieldId,
+        .builtSectors = vectorField.sectors ? vectorField.sectors->GetBuiltSectorCount() : 0,
+    };
+    if(!field.built || field.key != key)
+    {
+        ChunkGrid grid(navigation, CHUNK_SIZE);
+        const float tileSize = navigation.tileSize;
+        const float lineWidth = LINE_WIDTH * tileSize;
+        auto addVector = [&](uint32_t x, uint32_t y, Vector2 direction) {
+            const Vector3 start = {
+                .x = (float)x * tileSize + navigation.offsetX + tileSize * 0.5f,
+                .y = 0.2f,
+                .z = (float)y * tileSize + navigation.offsetY + tileSize * 0.5f};
+            const Vector3 end = Vector3Add(
+                start,
+                Vector3Scale({.x = direction.x, .y = 0.0f, .z = direction.y}, tileSize * 0.75f));
+
+            const Color color = [&]() {
+                switch(navigation.tileData.tiles[navigation.GetIndex(x, y)].GetType())
+                {
+                    case(Navigation::Tile::GOAL): return GREEN;
+                    case(Navigation::Tile::SPAWN): return BLUE;
+                    default: return RED;
+                }
+            }();
+
+            ChunkGeometry& chunk = grid.Get(x, y);
+            chunk.full.AddSquare(start, 0.1f, ColorAlpha(color, 0.2f));
+            chunk.full.AddLine(start, end, lineWidth, color);
+            if(x % COARSE_STEP == 0 && y % COARSE_STEP == 0)
+            {
+                chunk.coarse.AddSquare(start, 0.1f, ColorAlpha(color, 0.2f));
+                chunk.coarse.AddLine(start, end, lineWidth * COARSE_STEP, color);
+            }
+        };
+
+        // Only the sectors that something has asked for are drawn
+        if(vectorField.sectors)
+            vectorField.sectors->ForEachBuiltVector(addVector);
+        else
+            vectorField.ForEach(addVector);
+
+        Clear(field);
+        UploadChunks(grid.chunks, field.chunks);
+        field.key = key;
+        field.built = true;
+    }
+
+    Draw(field, navigation.tileSize);
+}
+
+void NavigationDebugDraw::Unload()
+{
+    Clear(tiles);
+    Clear(field);
+    if(materialLoaded)
+        UnloadMaterial(material);
+    materialLoaded = false;
+}
+
+void NavigationDebugDraw::Draw(const Overlay& overlay, float tileSize)
+{
+    if(!materialLoaded)
+    {
+        // Vertex colours times white
+        material = LoadMaterialDefault();
+        materialLoaded = true;
+    }
+
+    const Matrix projection = rlGetMatrixProjection();
+    const Matrix viewProjection = MatrixMultiply(rlGetMatrixModelview(), projection);
+    // How many pixels one unit at w = 1 covers on screen, for both perspective and orthographic
+    const float pixelsPerUnit = projection.m5 * (float)GetScreenHeight() * 0.5f;
+
+    // The quads are flat, so they have no back side to cull
+    rlDisableBackfaceCulling();
+    for(const Chunk& chunk : overlay.chunks)
+    {
+        if(IsOutsideView(viewProjection, chunk.bounds))
+            continue;
+
+        const Vector3 center = Vector3Lerp(chunk.bounds.min, chunk.bounds.max, 0.5f);
+        const float w = ToClipSpace(viewProjection, center).w;
+        const bool coarse = chunk.coarseMesh.vertexCount > 0 && w > 0.0f
+                            && tileSize * pixelsPerUnit / w < COARSE_TILE_PIXELS;
+        DrawMesh(coarse ? chunk.coarseMesh : chunk.mesh, material, MatrixIdentity());
+    }
+    rlEnableBackfaceCulling();
+}
+
+void NavigationDebugDraw::Clear(Overlay& overlay)
+{
+    for(const Chunk& chunk : overlay.chunks)
+    {
+        UnloadMesh(chunk.mesh);
+        if(chunk.coarseMesh.vertexCount > 0)
+            UnloadMesh(chunk.coarseMesh);
+    }
+    overlay.chunks.clear();
+    overlay.built = false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <navigation.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Draws the navigation debug overlays (walls from DrawTiles and the arrows of DrawField) from
+// meshes that are kept on the GPU and only rebuilt when the tiles or the field change, instead of
+// generating every line again every frame.
+//
+// The grid is split into chunks so that chunks outside of the view can be skipped. Field chunks
+// also get a coarse mesh with every few arrows only, which is drawn instead once the tiles are too
+// small on screen for every arrow to be told apart.
+class NavigationDebugDraw
+{
+  public:
+    // Both have to be called between BeginMode3D and EndMode3D
+    void DrawTiles(const Navigation& navigation);
+    void DrawField(const Navigation& navigation, int32_t fieldId);
+    // Frees the meshes. Has to be called before the window is closed
+    void Unload();
+
+  private:
+    static constexpr uint32_t CHUNK_SIZE = 32;
+    // Only every COARSE_STEP:th arrow along each axis is kept in the coarse meshes
+    static constexpr uint32_t COARSE_STEP = 4;
+    // Tiles smaller than this on screen switch a chunk over to its coarse mesh
+    static constexpr float COARSE_TILE_PIXELS = 8.0f;
+
+    struct Chunk
+    {
+        BoundingBox bounds;
+        Mesh mesh;
+        Mesh coarseMesh;
+    };
+
+    // Everything an overlay was built from. The overlay is rebuilt if any of it changes
+    struct OverlayKey
+    {
+        uint32_t generation = 0;
+        uint64_t tileVersion = 0;
+        uint64_t fieldVersion = 0;
+        int32_t fieldId = -1;
+        // Hierarchical fields build their sectors as they are used, see SectorField
+        uint32_t builtSectors = 0;
+
+        bool operator==(const OverlayKey& other) const = default;
+    };
+
+    struct Overlay
+    {
+        OverlayKey key;
+        bool built = false;
+        std::vector<Chunk> chunks;
+    };
+
+    Overlay tiles;
+    Overlay field;
+    Material material = {};
+    bool materialLoaded = false;
+
+    void Draw(const Overlay& overlay, float tileSize);
+    void Clear(Overlay& overlay);
+};
@@ -0,0 +1,103 @@
+#include "navigation.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define NAVIGATION_SSE2
+#endif
+
+// Two-pass chamfer transform where all 8 neighbours are one step away, which gives the same
+// Chebyshev distance as scanning growing rings around every tile.
+//
+// Each raster pass is split into two parts: taking the minimum with the row before, which has no
+// dependencies between tiles in the row and is done 8 tiles at a time, and a scalar scan along the
+// row for the tile before. This is the same thing as a plain raster pass since the tile before is
+// always final by the time it is read.
+
+namespace
+{
+    using Distance = int16_t;
+    constexpr Distance FAR = std::numeric_limits<Distance>::max();
+
+    Distance StepFrom(Distance distance)
+    {
+        return distance == FAR ? FAR : (Distance)(distance + 1);
+    }
+
+    // row[x] = min(row[x], other[x - 1] + 1, other[x] + 1, other[x + 1] + 1) for x in [1; end)
+    void MinWithRow(Distance* row, const Distance* other, size_t end)
+    {
+        size_t x = 1;
+#ifdef NAVIGATION_SSE2
+        const __m128i one = _mm_set1_epi16(1);
+        for(; x + 8 <= end; x += 8)
+        {
+            const __m128i left = _mm_loadu_si128((const __m128i*)(other + x - 1));
+            const __m128i middle = _mm_loadu_si128((const __m128i*)(other + x));
+            const __m128i right = _mm_loadu_si128((const __m128i*)(other + x + 1));
+            // Saturating so FAR stays FAR
+            const __m128i neighbours =
+                _mm_adds_epi16(_mm_min_epi16(_mm_min_epi16(left, middle), right), one);
+
+            const __m128i current = _mm_loadu_si128((const __m128i*)(row + x));
+            _mm_storeu_si128((__m128i*)(row + x), _mm_min_epi16(current, neighbours));
+        }
+#endif
+        for(; x < end; ++x)
+        {
+            const Distance neighbours = std::min({other[x - 1], other[x], other[x + 1]});
+            row[x] = std::min(row[x], StepFrom(neighbours));
+        }
+    }
+}
+
+void Navigation::GetDistancesToUnpassable(
+    uint32_t spawnId,
+    uint32_t goalId,
+    std::vector<int32_t>& distances) const
+{
+    const size_t sizeX = tileData.sizeX;
+    const size_t sizeY = tileData.sizeY;
+
+    // Padded with one unpassable tile on every side so that the edges of the map are unpassable
+    // without any bounds checks
+    const size_t stride = sizeX + 2;
+    std::vector<Distance> grid(stride * (sizeY + 2), 0);
+    for(uint32_t y = 0; y < sizeY; ++y)
+    {
+        Distance* row = grid.data() + (y + 1) * stride + 1;
+        ForEachPassable(goalId, y, [&](uint32_t x) { row[x] = FAR; });
+    }
+
+    const size_t end = sizeX + 1;
+    for(size_t y = 1; y <= sizeY; ++y)
+    {
+        Distance* row = grid.data() + y * stride;
+        MinWithRow(row, row - stride, end);
+        for(size_t x = 1; x < end; ++x)
+            row[x] = std::min(row[x], StepFrom(row[x - 1]));
+    }
+    for(size_t y = sizeY; y >= 1; --y)
+    {
+        Distance* row = grid.data() + y * stride;
+        MinWithRow(row, row + stride, end);
+        for(size_t x = end - 1; x >= 1; --x)
+            row[x] = std::min(row[x], StepFrom(row[x + 1]));
+    }
+
+    distances.resize(sizeX * sizeY);
+    for(size_t y = 0; y < sizeY; ++y)
+    {
+        const Distance* row = grid.data() + (y + 1) * stride + 1;
+        for(size_t x = 0; x < sizeX; ++x)
+        {
+            // Reachable tiles that can't be passed count as being next to an unpassable tile
+            distances[y * sizeX + x] =
+                IsReachable((int64_t)x, (int64_t)y) ? std::max<int32_t>(row[x], 1) : 0;
+        }
+    }
+}
@@ -0,0 +1,1010 @@
+#include "navigation.hpp"
+#include "navigation_sector_field.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <optional>
+#include <queue>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define NAVIGATION_SSE2
+#endif
+
+// This is a port of the walker-based field construction that used to live in
+// navigation_tools.lua. Walkers start at the goal and follow the walls outwards, layer by layer,
+// which gives fields that hug walls instead of the diagonal mess that plain Dijkstras creates.
+
+namespace
+{
+    using Side = Navigation::Tile::Side;
+    using WalkerTile = Navigation::WalkerTile;
+
+    // 0 is reserved for unreachable tiles!
+    constexpr int32_t UNSET = -1;
+    constexpr uint32_t MAX_DISTANCE = 999999;
+
+    struct Neighbour
+    {
+        int64_t x;
+        int64_t y;
+        Side direction;
+        Side opposite;
+    };
+
+    std::array<Neighbour, 4> GetNeighbours(int64_t x, int64_t y)
+    {
+        return {{
+            {.x = x, .y = y - 1, .direction = Side::TOP, .opposite = Side::BOTTOM},
+            {.x = x, .y = y + 1, .direction = Side::BOTTOM, .opposite = Side::TOP},
+            {.x = x - 1, .y = y, .direction = Side::LEFT, .opposite = Side::RIGHT},
+            {.x = x + 1, .y = y, .direction = Side::RIGHT, .opposite = Side::LEFT},
+        }};
+    }
+
+    // The tile the given tile's parentDirection points at
+    void StepToParent(int64_t& x, int64_t& y, Side parentDirection)
+    {
+        switch(parentDirection)
+        {
+            case Side::TOP: y -= 1; break;
+            case Side::BOTTOM: y += 1; break;
+            case Side::LEFT: x -= 1; break;
+            case Side::RIGHT: x += 1; break;
+            case Side::NONE: break;
+        }
+    }
+
+    Navigation::TileArea ExpandArea(
+        Navigation::TileArea area,
+        uint32_t amount,
+        uint32_t sizeX,
+        uint32_t sizeY)
+    {
+        return {
+            .minX = area.minX > amount ? area.minX - amount : 0,
+            .minY = area.minY > amount ? area.minY - amount : 0,
+            .maxX = std::min(area.maxX + amount, sizeX),
+            .maxY = std::min(area.maxY + amount, sizeY),
+        };
+    }
+
+    // Steps away from the parent, i.e. continues in the direction a walker was already going
+    void StepInDirection(int64_t& x, int64_t& y, Side direction)
+    {
+        switch(direction)
+        {
+            case Side::TOP: y += 1; break;
+            case Side::BOTTOM: y -= 1; break;
+            case Side::LEFT: x += 1; break;
+            case Side::RIGHT: x -= 1; break;
+            case Side::NONE: break;
+        }
+    }
+
+    Vector2 DirectionToVector(Side direction)
+    {
+        switch(direction)
+        {
+            case Side::TOP: return {.x = 0.0f, .y = -1.0f};
+            case Side::BOTTOM: return {.x = 0.0f, .y = 1.0f};
+            case Side::LEFT: return {.x = -1.0f, .y = 0.0f};
+            case Side::RIGHT: return {.x = 1.0f, .y = 0.0f};
+            case Side::NONE: break;
+        }
+        return {.x = 0.0f, .y = 0.0f};
+    }
+
+    struct OpenListTile
+    {
+        int64_t x;
+        int64_t y;
+        // Set when a new walker is spawned on this tile
+        std::optional<int32_t> wallId;
+        std::optional<int32_t> id;
+    };
+    // to[i] += from[i] for i in [0; count)
+    void AddRow(float* to, const float* from, size_t count)
+    {
+        size_t i = 0;
+#ifdef NAVIGATION_SSE2
+        for(; i + 4 <= count; i += 4)
+            _mm_storeu_ps(to + i, _mm_add_ps(_mm_loadu_ps(to + i), _mm_loadu_ps(from + i)));
+#endif
+        for(; i < count; ++i)
+            to[i] += from[i];
+    }
+
+    // Shared by everything that reads the tiles from the point of view of one spawn/goal pair
+    class FieldContext
+    {
+      public:
+        FieldContext(const Navigation& navigation, uint32_t spawnId, uint32_t goalId)
+            : navigation(navigation)
+            , spawnId(spawnId)
+            , goalId(goalId)
+            , sizeX(navigation.GetSizeX())
+            , sizeY(navigation.GetSizeY())
+        {
+        }
+
+      protected:
+        const Navigation& navigation;
+        const uint32_t spawnId;
+        const uint32_t goalId;
+        const uint32_t sizeX;
+        const uint32_t sizeY;
+
+        size_t Index(int64_t x, int64_t y) const
+        {
+            return (size_t)y * sizeX + (size_t)x;
+        }
+
+        bool IsPassable(int64_t x, int64_t y) const
+        {
+            return navigation.IsPassable(spawnId, goalId, x, y);
+        }
+
+        // For the given tile, find the tile-distance to the nearest unpassable tile. Only meant for
+        // a few tiles, use Navigation::GetDistancesToUnpassable for the whole grid
+        int32_t DistanceToUnpassable(int64_t x, int64_t y) const
+        {
+            if(!navigation.IsReachable(x, y))
+                return 0;
+
+            // The rings below skip the tile itself
+            if(!IsPassable(x, y))
+                return 1;
+
+            // Everything outside the map is unpassable, so this always finds something
+            const int64_t maxRadius = std::max(sizeX, sizeY);
+            for(int64_t radius = 1; radius <= maxRadius; ++radius)
+            {
+                for(int64_t ry = -radius; ry <= radius; ++ry)
+                {
+                    // Smaller radii have already been checked, so only look at the edge
+                    const bool edgeRow = ry == -radius || ry == radius;
+                    if(edgeRow
+                           ? !navigation.IsSpanPassable(goalId, x - radius, x + radius + 1, y + ry)
+                           : !IsPassable(x - radius, y + ry) || !IsPassable(x + radius, y + ry))
+                    {
+                        return (int32_t)radius;
+                    }
+                }
+            }
+
+            return -1;
+        }
+
+        // "raw" vector without any smoothing
+        Vector2 RawVector(const std::vector<WalkerTile>& walkers, int64_t x, int64_t y) const
+        {
+            if(navigation.IsReachable(x, y))
+                return DirectionToVector(walkers[Index(x, y)].parentDirection);
+
+            // Make all unwalkable tiles that are adjacent to walkable tiles push entities towards
+            // the walkable tile. This is in case someone feels like wandering off the map
+            Vector2 toMap = {.x = 0.0f, .y = 0.0f};
+            for(int64_t ry = -1; ry <= 1; ++ry)
+            {
+                for(int64_t rx = -1; rx <= 1; ++rx)
+                {
+                    if((rx != 0 || ry != 0) && navigation.IsReachable(x + rx, y + ry))
+                    {
+                        toMap.x += (float)rx;
+                        toMap.y += (float)ry;
+                    }
+                }
+            }
+
+            // Let's not track down nan issues again
+            return Vector2Normalize(toMap);
+        }
+
+        // Writes the final vectors of every tile in the given area. When smoothing, every passable
+        // tile is averaged with the passable tiles within GetSmoothRadius of it
+        void WriteVectors(
+            const std::vector<WalkerTile>& walkers,
+            const Navigation::FlowFieldOptions& options,
+            Navigation::TileArea area,
+            std::vector<Vector2>& vectors) const
+        {
+            const int64_t radius = options.smooth ? GetSmoothRadius() : 0;
+
+            // Raw vectors for the area plus the margin that smoothing reads from
+            const int64_t rawMinX = std::max<int64_t>((int64_t)area.minX - radius, 0);
+            const int64_t rawMinY = std::max<int64_t>((int64_t)area.minY - radius, 0);
+            const int64_t rawMaxX = std::min<int64_t>(area.maxX + radius, sizeX);
+            const int64_t rawMaxY = std::min<int64_t>(area.maxY + radius, sizeY);
+            const int64_t rawSizeX = rawMaxX - rawMinX;
+            const int64_t rawSizeY = rawMaxY - rawMinY;
+            if(rawSizeX <= 0 || rawSizeY <= 0)
+                return;
+
+            std::vector<Vector2> raw((size_t)(rawSizeX * rawSizeY));
+            for(int64_t y = rawMinY; y < rawMaxY; ++y)
+            {
+                for(int64_t x = rawMinX; x < rawMaxX; ++x)
+                    raw[(y - rawMinY) * rawSizeX + (x - rawMinX)] = RawVector(walkers, x, y);
+            }
+            auto rawIndex = [&](int64_t x, int64_t y) {
+                return (size_t)((y - rawMinY) * rawSizeX + (x - rawMinX));
+            };
+
+            if(!options.smooth)
+            {
+                for(int64_t y = area.minY; y < (int64_t)area.maxY; ++y)
+                {
+                    for(int64_t x = area.minX; x < (int64_t)area.maxX; ++x)
+                        vectors[Index(x, y)] = raw[rawIndex(x, y)];
+                }
+                return;
+            }
+
+            // The box sum is separable: sum each row over the window first, then sum the row sums
+            // over the window. Unpassable tiles and tiles outside the map are zero, which takes
+            // care of the masking. x and y are kept in separate planes so every step adds whole
+            // rows
+            const size_t paddedSizeX = (size_t)(rawSizeX + radius * 2);
+            std::vector<float> maskedX(paddedSizeX * rawSizeY, 0.0f);
+            std::vector<float> maskedY(paddedSizeX * rawSizeY, 0.0f);
+            std::vector<bool> passable((size_t)(rawSizeX * rawSizeY));
+            for(int64_t y = rawMinY; y < rawMaxY; ++y)
+            {
+                const size_t row = (size_t)(y - rawMinY) * paddedSizeX + radius;
+                for(int64_t x = rawMinX; x < rawMaxX; ++x)
+                {
+                    const size_t index = rawIndex(x, y);
+                    passable[index] = IsPassable(x, y);
+                    if(!passable[index])
+                        continue;
+
+                    maskedX[row + (x - rawMinX)] = raw[index].x;
+                    maskedY[row + (x - rawMinX)] = raw[index].y;
+                }
+            }
+
+            std::vector<float> rowSumsX((size_t)(rawSizeX * rawSizeY), 0.0f);
+            std::vector<float> rowSumsY((size_t)(rawSizeX * rawSizeY), 0.0f);
+            for(int64_t y = 0; y < rawSizeY; ++y)
+            {
+                for(int64_t offset = 0; offset <= radius * 2; ++offset)
+                {
+                    const size_t from = (size_t)y * paddedSizeX + offset;
+                    AddRow(&rowSumsX[y * rawSizeX], &maskedX[from], rawSizeX);
+                    AddRow(&rowSumsY[y * rawSizeX], &maskedY[from], rawSizeX);
+                }
+            }
+
+            const size_t areaSizeX = area.maxX - area.minX;
+            std::vector<float> sumX(areaSizeX);
+            std::vector<float> sumY(areaSizeX);
+            for(int64_t y = area.minY; y < (int64_t)area.maxY; ++y)
+            {
+                std::fill(sumX.begin(), sumX.end(), 0.0f);
+                std::fill(sumY.begin(), sumY.end(), 0.0f);
+                const int64_t minY = std::max(y - radius, rawMinY);
+                const int64_t maxY = std::min(y + radius + 1, rawMaxY);
+                for(int64_t yy = minY; yy < maxY; ++yy)
+                {
+                    AddRow(sumX.data(), &rowSumsX[rawIndex(area.minX, yy)], areaSizeX);
+                    AddRow(sumY.data(), &rowSumsY[rawIndex(area.minX, yy)], areaSizeX);
+                }
+
+                for(int64_t x = area.minX; x < (int64_t)area.maxX; ++x)
+                {
+                    const size_t index = rawIndex(x, y);
+                    const size_t sumIndex = (size_t)(x - area.minX);
+                    vectors[Index(x, y)] =
+                        passable[index]
+                            ? Vector2Normalize({.x = sumX[sumIndex], .y = sumY[sumIndex]})
+                            : raw[index];
+                }
+            }
+        }
+
+        // The smoothing window used to be 5x5 tiles at the default tile size of 0.5, so keep it
+        // at about the same size in world units for other tile sizes
+        int64_t GetSmoothRadius() const
+        {
+            constexpr float SMOOTH_DISTANCE = 1.0f;
+            return std::max<int64_t>(
+                (int64_t)std::lround(SMOOTH_DISTANCE / navigation.tileSize),
+                1);
+        }
+    };
+
+    class FlowFieldBuilder : FieldContext
+    {
+      public:
+        using FieldContext::FieldContext;
+
+        bool Build(const Navigation::FlowFieldOptions& options, Navigation::VectorField& out)
+        {
+            if(options.hierarchical)
+            {
+                out.sectors = Navigation::SectorField::Build(navigation, spawnId, goalId);
+                out.sizeX = sizeX;
+                out.sizeY = sizeY;
+                out.options = options;
+                return out.sectors != nullptr;
+            }
+
+            Init();
+            if(openList.empty())
+                return false;
+
+            Walk();
+
+            out.sizeX = sizeX;
+            out.sizeY = sizeY;
+            out.vectors.resize((size_t)sizeX * sizeY);
+            WriteVectors(walkers, options, {.maxX = sizeX, .maxY = sizeY}, out.vectors);
+            out.walkers = std::move(walkers);
+            out.options = options;
+
+            return true;
+        }
+
+      private:
+        std::vector<WalkerTile> walkers;
+        std::vector<bool> spawnTiles;
+        std::deque<OpenListTile> openList;
+        std::deque<Neighbour> gateList;
+        int32_t idCounter = 1;
+
+        int32_t GetId()
+        {
+            return idCounter++;
+        }
+
+        // Given two adjacent tiles, check if there is an unpassable tile within searchRadius of
+        // both of them, i.e. if they share a wall
+        bool HasSharedWall(int64_t x, int64_t y, int64_t ox, int64_t oy, int64_t searchRadius) const
+        {
+            const int64_t minX = std::max(x, ox) - searchRadius;
+            const int64_t maxX = std::min(x, ox) + searchRadius;
+            const int64_t minY = std::max(y, oy) - searchRadius;
+            const int64_t maxY = std::min(y, oy) + searchRadius;
+
+            for(int64_t yy = minY; yy <= maxY; ++yy)
+            {
+                if(!navigation.IsSpanPassable(goalId, minX, maxX + 1, yy))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Checks whether or not the given tile is adjacent to the walker with the given wall id
+        bool IsAdjacentToWalker(int64_t x, int64_t y, int32_t walkerWallId) const
+        {
+            for(int64_t ry = -1; ry <= 1; ++ry)
+            {
+                for(int64_t rx = -1; rx <= 1; ++rx)
+                {
+                    if(IsPassable(x + rx, y + ry))
+                    {
+                        if(walkers[Index(x + rx, y + ry)].id == walkerWallId)
+                            return true;
+                    }
+                    else if(walkerWallId == 0) // wallId 0 is reserved
+                        return true;
+                }
+            }
+
+            return false;
+        }
+
+        // Sets the given position as the walker's next step
+        void SetNextWalkerStep(const WalkerTile& walker, int64_t x, int64_t y, Side parentDirection)
+        {
+            // Copy since the walker may be the tile itself
+            const WalkerTile current = walker;
+            WalkerTile& next = walkers[Index(x, y)];
+            next.id = current.id;
+            next.distance = current.distance + 1;
+            next.wallId = current.wallId;
+            next.parentDirection = parentDirection;
+        }
+
+        void Init()
+        {
+            walkers.resize((size_t)sizeX * sizeY);
+            spawnTiles.assign((size_t)sizeX * sizeY, false);
+
+            std::vector<int32_t> distances;
+            navigation.GetDistancesToUnpassable(spawnId, goalId, distances);
+            for(uint32_t y = 0; y < sizeY; ++y)
+            {
+                for(uint32_t x = 0; x < sizeX; ++x)
+                {
+                    const int32_t distanceToUnpassable = distances[Index(x, y)];
+                    walkers[Index(x, y)] = {
+                        // All unreachable tiles are given the special id 0
+                        .id = distanceToUnpassable > 0 ? UNSET : 0,
+                        .wallId = UNSET,
+                        .distance = MAX_DISTANCE,
+                        .distanceToUnpassable = distanceToUnpassable,
+                        .parentDirection = Side::NONE,
+                        .locked = false,
+                    };
+                }
+            }
+
+            // Starting condition
+            navigation.ForEachTile([&](uint32_t x, uint32_t y, Navigation::Tile tile) {
+                WalkerTile& walker = walkers[Index(x, y)];
+                if(tile.GetType() == Navigation::Tile::GOAL && walker.distanceToUnpassable == 1)
+                {
+                    if(goalId < Navigation::MAX_GOAL_ID
+                       && (navigation.GetIds(x, y) & (1u << goalId)) != 0)
+                    {
+                        walker.wallId = 0;
+                        walker.distance = 0;
+                        walker.id = GetId();
+                        openList.push_back({.x = x, .y = y});
+                    }
+                }
+                else if(tile.GetType() == Navigation::Tile::SPAWN
+                        && (navigation.GetIds(x, y) >> 16) == spawnId)
+                {
+                    spawnTiles[Index(x, y)] = true;
+                }
+            });
+        }
+
+        // Steps all walkers in the open list until they cannot go any further
+        void StepWalkers()
+        {
+            while(!openList.empty())
+            {
+                const OpenListTile current = openList.front();
+                openList.pop_front();
+
+                const size_t currentIndex = Index(current.x, current.y);
+                WalkerTile& cWalker = walkers[currentIndex];
+                if(current.id)
+                    cWalker.id = *current.id;
+                if(current.wallId)
+                    cWalker.wallId = *current.wallId;
+
+                if(!spawnTiles[currentIndex] && !cWalker.locked)
+                {
+                    for(const Neighbour& n : GetNeighbours(current.x, current.y))
+                    {
+                        if(IsPassable(n.x, n.y))
+                        {
+                            if(walkers[Index(n.x, n.y)].id != UNSET)
+                                continue;
+                            if(!IsAdjacentToWalker(n.x, n.y, cWalker.wallId))
+                                continue;
+
+                            bool valid = true;
+                            if(cWalker.wallId == 0)
+                            {
+                                valid = HasSharedWall(
+                                    current.x,
+                                    current.y,
+                                    n.x,
+                                    n.y,
+                                    cWalker.distanceToUnpassable);
+                            }
+                            else
+                            {
+                                for(const Neighbour& nn : GetNeighbours(n.x, n.y))
+                                {
+                                    if(!IsPassable(nn.x, nn.y))
+                                        continue;
+
+                                    const WalkerTile& nnWalker = walkers[Index(nn.x, nn.y)];
+                                    if(nnWalker.id != cWalker.wallId
+                                       && nnWalker.distanceToUnpassable
+                                              == cWalker.distanceToUnpassable - 1)
+                                    {
+                                        valid = false;
+                                        break;
+                                    }
+                                }
+                            }
+
+                            if(valid)
+                            {
+                                openList.push_back({.x = n.x, .y = n.y});
+                                SetNextWalkerStep(cWalker, n.x, n.y, n.opposite);
+                            }
+                        }
+                        else if(navigation.IsNavGate(n.x, n.y))
+                        {
+                            // When a NavGate is found, use Dijkstras to move back towards the
+                            // "valid" portion of the map. The walker distance is hijacked so
+                            // another map doesn't have to be created
+                            WalkerTile& gateWalker = walkers[Index(n.x, n.y)];
+                            gateWalker.distance = 0;
+                            gateWalker.parentDirection = n.opposite;
+                            gateList.push_back(n);
+                        }
+                    }
+                }
+                else
+                {
+                    // A walker that crosses a spawn keeps going straight and locks every tile
+                    cWalker.locked = true;
+
+                    const Side parentDirection = cWalker.parentDirection;
+                    SetNextWalkerStep(cWalker, current.x, current.y, parentDirection);
+
+                    int64_t nextX = current.x;
+                    int64_t nextY = current.y;
+                    StepInDirection(nextX, nextY, parentDirection);
+                    if(IsPassable(nextX, nextY) && walkers[Index(nextX, nextY)].id == UNSET)
+                    {
+                        walkers[Index(nextX, nextY)].locked = true;
+
+                        openList.push_back({.x = nextX, .y = nextY});
+                        SetNextWalkerStep(cWalker, nextX, nextY, parentDirection);
+                    }
+                }
+            }
+        }
+
+        void FloodFromGates()
+        {
+            while(!gateList.empty())
+            {
+                const Neighbour current = gateList.front();
+                gateList.pop_front();
+
+                const uint32_t distance = walkers[Index(current.x, current.y)].distance;
+                for(const Neighbour& n : GetNeighbours(current.x, current.y))
+                {
+                    if(!navigation.IsValid(n.x, n.y))
+                        continue;
+
+                    WalkerTile& nWalker = walkers[Index(n.x, n.y)];
+                    if(nWalker.id == UNSET && nWalker.distance > distance + 1)
+                    {
+                        nWalker.distance = distance + 1;
+                        nWalker.parentDirection = n.opposite;
+                        gateList.push_back(n);
+                    }
+                }
+            }
+        }
+
+        // For each walker, find the closest place where a new walker can be spawned and spawn
+        // it. Returns whether or not any walker was spawned
+        bool SpawnWalkers(int32_t processedDistance)
+        {
+            struct SpawnData
+            {
+                uint32_t distance;
+                int64_t x;
+                int64_t y;
+            };
+            // Ordered so that the result doesn't depend on hashing
+            std::map<int32_t, SpawnData> spawnMap;
+
+            for(uint32_t y = 0; y < sizeY; ++y)
+            {
+                for(uint32_t x = 0; x < sizeX; ++x)
+                {
+                    const size_t index = Index(x, y);
+                    const WalkerTile& cWalker = walkers[index];
+                    if(cWalker.distanceToUnpassable != processedDistance || spawnTiles[index]
+                       || cWalker.id == UNSET)
+                        continue;
+
+                    for(const Neighbour& n : GetNeighbours(x, y))
+                    {
+                        if(!IsPassable(n.x, n.y))
+                            continue;
+
+                        const WalkerTile& nWalker = walkers[Index(n.x, n.y)];
+                        if(nWalker.distanceToUnpassable == processedDistance + 1
+                           && nWalker.id == UNSET)
+                        {
+                            auto iter = spawnMap.find(cWalker.id);
+                            if(iter == spawnMap.end() || iter->second.distance > cWalker.distance)
+                            {
+                                spawnMap[cWalker.id] = {
+                                    .distance = cWalker.distance,
+                                    .x = x,
+                                    .y = y,
+                                };
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+
+            for(const auto& [wallId, spawnData] : spawnMap)
+            {
+                for(const Neighbour& n : GetNeighbours(spawnData.x, spawnData.y))
+                {
+                    if(!IsPassable(n.x, n.y))
+                        continue;
+
+                    // The id is set once the tile is popped from the open list, so the same tile
+                    // may be queued more than once
+                    WalkerTile& nWalker = walkers[Index(n.x, n.y)];
+                    if(nWalker.id == UNSET)
+                    {
+                        openList.push_back(
+                            {.x = n.x, .y = n.y, .wallId = wallId, .id = GetId()});
+                        nWalker.wallId = wallId;
+                        nWalker.distance = 0;
+                        nWalker.parentDirection = n.opposite;
+                    }
+                }
+            }
+
+            return !spawnMap.empty();
+        }
+
+        void Walk()
+        {
+            int32_t processedDistance = 1;
+            bool anyAddedLastIter = false;
+            // 9999 set to avoid an infinite loop, but this should be exited when no more tiles
+            // are available to explore
+            while(processedDistance < 9999)
+            {
+                StepWalkers();
+                FloodFromGates();
+
+                const bool anyAdded = SpawnWalkers(processedDistance);
+
+                // It is possible that it takes multiple runs of the loop to step on all tiles
+                // with a distanceToUnpassable of processedDistance + 1. In that case the same
+                // distance will be processed again
+                if(!anyAdded)
+                {
+                    processedDistance++;
+
+                    if(!anyAddedLastIter)
+                        break;
+                }
+
+                anyAddedLastIter = anyAdded;
+            }
+        }
+    };
+
+    // Patches up a built field after some tiles have changed. Every tile in the dirty area, and
+    // every tile whose path to the goal went through it, is detached and then re-attached to the
+    // rest of the field along the shortest path. The walkers are not run again, so the result can
+    // differ slightly from a full build
+    class FlowFieldRepairer : FieldContext
+    {
+      public:
+        using FieldContext::FieldContext;
+
+        void Repair(Navigation::TileArea dirtyArea, Navigation::VectorField& field)
+        {
+            std::vector<WalkerTile>& walkers = field.walkers;
+            assert(walkers.size() == (size_t)sizeX * sizeY);
+
+            const Navigation::TileArea touched = Detach(dirtyArea, walkers);
+            CalculateCosts(walkers);
+            Attach(walkers);
+
+            // Unreachable tiles next to the touched ones point towards them, and smoothing reads
+            // even further out
+            const uint32_t margin = 1 + (field.options.smooth ? (uint32_t)GetSmoothRadius() : 0);
+            WriteVectors(
+                walkers,
+                field.options,
+                ExpandArea(touched, margin, sizeX, sizeY),
+                field.vectors);
+        }
+
+      private:
+        static constexpr uint32_t UNKNOWN_COST = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t NO_PATH = UNKNOWN_COST - 1;
+        static constexpr uint32_t IN_PROGRESS = UNKNOWN_COST - 2;
+
+        std::vector<bool> detached;
+        std::vector<std::pair<int64_t, int64_t>> detachedTiles;
+        // Number of steps to the goal when following parentDirection
+        std::vector<uint32_t> costs;
+
+        bool IsGoalRoot(int64_t x, int64_t y) const
+        {
+            return navigation.IsGoal(x, y) && goalId < Navigation::MAX_GOAL_ID
+                   && (navigation.GetIds(x, y) & (1u << goalId)) != 0;
+        }
+
+        // Returns the area covering every detached tile
+        Navigation::TileArea Detach(
+            Navigation::TileArea dirtyArea,
+            std::vector<WalkerTile>& walkers)
+        {
+            detached.assign((size_t)sizeX * sizeY, false);
+            Navigation::TileArea touched = dirtyArea;
+
+            int32_t nextId = 1;
+            for(const WalkerTile& walker : walkers)
+                nextId = std::max(nextId, walker.id + 1);
+
+            std::deque<std::pair<int64_t, int64_t>> openList;
+            for(uint32_t y = dirtyArea.minY; y < dirtyArea.maxY; ++y)
+            {
+                for(uint32_t x = dirtyArea.minX; x < dirtyArea.maxX; ++x)
+                {
+                    detached[Index(x, y)] = true;
+                    openList.push_back({x, y});
+                }
+            }
+
+            // Anything whose path goes through the dirty area has to find a new one
+            while(!openList.empty())
+            {
+                const auto [x, y] = openList.front();
+                openList.pop_front();
+                detachedTiles.push_back({x, y});
+
+                for(const Neighbour& n : GetNeighbours(x, y))
+                {
+                    if(!navigation.IsValid(n.x, n.y) || detached[Index(n.x, n.y)])
+                        continue;
+                    if(walkers[Index(n.x, n.y)].parentDirection != n.opposite)
+                        continue;
+
+                    detached[Index(n.x, n.y)] = true;
+                    openList.push_back({n.x, n.y});
+
+                    touched.minX = std::min(touched.minX, (uint32_t)n.x);
+                    touched.minY = std::min(touched.minY, (uint32_t)n.y);
+                    touched.maxX = std::max(touched.maxX, (uint32_t)n.x + 1);
+                    touched.maxY = std::max(touched.maxY, (uint32_t)n.y + 1);
+                }
+            }
+
+            for(const auto& [x, y] : detachedTiles)
+            {
+                const int32_t distanceToUnpassable = DistanceToUnpassable(x, y);
+                walkers[Index(x, y)] = {
+                    .id = distanceToUnpassable > 0 ? UNSET : 0,
+                    .wallId = UNSET,
+                    .distance = MAX_DISTANCE,
+                    .distanceToUnpassable = distanceToUnpassable,
+                    .parentDirection = Side::NONE,
+                    .locked = false,
+                };
+
+                // New goal tiles are where new paths start
+                if(IsGoalRoot(x, y))
+                {
+                    WalkerTile& walker = walkers[Index(x, y)];
+                    walker.id = nextId++;
+                    walker.wallId = 0;
+                    walker.distance = 0;
+                }
+            }
+
+            return touched;
+        }
+
+        void CalculateCosts(const std::vector<WalkerTile>& walkers)
+        {
+            costs.assign((size_t)sizeX * sizeY, UNKNOWN_COST);
+
+            std::vector<size_t> chain;
+            for(uint32_t y = 0; y < sizeY; ++y)
+            {
+                for(uint32_t x = 0; x < sizeX; ++x)
+                {
+                    // Follow the path until a tile with a known cost is found, then walk back
+                    // along it and fill in the costs
+                    int64_t cx = x;
+                    int64_t cy = y;
+                    uint32_t cost = UNKNOWN_COST;
+                    while(true)
+                    {
+                        const size_t index = Index(cx, cy);
+                        if(costs[index] == IN_PROGRESS)
+                        {
+                            // Circular path, shouldn't happen but don't hang if it does
+                            cost = NO_PATH;
+                            break;
+                        }
+                        if(costs[index] != UNKNOWN_COST)
+                        {
+                            cost = costs[index];
+                            break;
+                        }
+
+                        const Side parentDirection = walkers[index].parentDirection;
+                        if(parentDirection == Side::NONE)
+                        {
+                            costs[index] = IsGoalRoot(cx, cy) ? 0 : NO_PATH;
+                            cost = costs[index];
+                            break;
+                        }
+
+                        costs[index] = IN_PROGRESS;
+                        chain.push_back(index);
+                        StepToParent(cx, cy, parentDirection);
+                        if(!navigation.IsValid(cx, cy))
+                        {
+                            cost = NO_PATH;
+                            break;
+                        }
+                    }
+
+                    while(!chain.empty())
+                    {
+                        cost = cost == NO_PATH ? NO_PATH : cost + 1;
+                        costs[chain.back()] = cost;
+                        chain.pop_back();
+                    }
+                }
+            }
+        }
+
+        // Dijkstras from the tiles next to the detached ones. Passable tiles are attached first.
+        // Anything left over is reachable but not passable, those are routed the shortest way
+        // back to a passable tile the same way nav gates are during the build
+        void Attach(std::vector<WalkerTile>& walkers)
+        {
+            using OpenTile = std::pair<uint32_t, std::pair<int64_t, int64_t>>;
+            for(const bool passableOnly : {true, false})
+            {
+                std::priority_queue<OpenTile, std::vector<OpenTile>, std::greater<OpenTile>>
+                    openList;
+                for(const auto& [x, y] : detachedTiles)
+                {
+                    // Goal tiles on the first pass, anything attached on the second
+                    if(costs[Index(x, y)] < IN_PROGRESS)
+                        openList.push({costs[Index(x, y)], {x, y}});
+
+                    for(const Neighbour& n : GetNeighbours(x, y))
+                    {
+                        if(navigation.IsValid(n.x, n.y) && !detached[Index(n.x, n.y)]
+                           && costs[Index(n.x, n.y)] < IN_PROGRESS)
+                        {
+                            openList.push({costs[Index(n.x, n.y)], {n.x, n.y}});
+                        }
+                    }
+                }
+
+                while(!openList.empty())
+                {
+                    const auto [cost, position] = openList.top();
+                    const auto [x, y] = position;
+                    openList.pop();
+                    if(cost != costs[Index(x, y)])
+                        continue;
+
+                    const WalkerTile& parent = walkers[Index(x, y)];
+                    for(const Neighbour& n : GetNeighbours(x, y))
+                    {
+                        if(!navigation.IsValid(n.x, n.y))
+                            continue;
+
+                        const size_t index = Index(n.x, n.y);
+                        if(!detached[index] || costs[index] <= cost + 1)
+                            continue;
+                        const bool canEnter = passableOnly ? IsPassable(n.x, n.y)
+                                                           : navigation.IsReachable(n.x, n.y);
+                        if(!canEnter)
+                            continue;
+
+                        costs[index] = cost + 1;
+                        WalkerTile& walker = walkers[index];
+                        walker.id = passableOnly ? parent.id : UNSET;
+                        walker.wallId = parent.wallId;
+                        walker.distance = parent.distance + 1;
+                        walker.parentDirection = n.opposite;
+                        openList.push({cost + 1, {n.x, n.y}});
+                    }
+                }
+            }
+        }
+    };
+}
+
+int32_t Navigation::GetFieldId(uint32_t spawnId, uint32_t goalId)
+{
+    return (int32_t)((spawnId << 16) | goalId);
+}
+
+bool Navigation::BuildFlowFields(uint32_t spawnId, uint32_t goalId, FlowFieldOptions options)
+{
+    VectorField field;
+    if(!FlowFieldBuilder(*this, spawnId, goalId).Build(options, field))
+        return false;
+
+    FieldHandle handle = ResolveField(GetFieldId(spawnId, goalId));
+    tileData.vectorFields[handle.index] = std::move(field);
+    ++fieldVersion;
+
+    return true;
+}
+
+const Navigation::WalkerTile* Navigation::GetWalkerTile(int32_t fieldId, uint32_t x, uint32_t y)
+    const
+{
+    auto iter = tileData.fieldIndices.find(fieldId);
+    if(iter == tileData.fieldIndices.end() || !IsValid(x, y))
+        return nullptr;
+
+    const VectorField& field = tileData.vectorFields[iter->second];
+    if(field.walkers.empty())
+        return nullptr;
+
+    return &field.walkers[GetIndex(x, y)];
+}
+
+std::vector<bool> Navigation::BakeFlowFields(
+    const std::vector<FlowFieldPair>& pairs,
+    FlowFieldOptions options,
+    ThreadPool& threadPool)
+{
+    // The builders only read from the tiles, so each pair can be built on its own thread
+    std::vector<VectorField> fields(pairs.size());
+    // Not std::vector<bool> since its elements can't be written from several threads
+    std::vector<uint8_t> built(pairs.size(), 0);
+    threadPool.ParallelFor(pairs.size(), [&](size_t i) {
+        const FlowFieldPair& pair = pairs[i];
+        built[i] = FlowFieldBuilder(*this, pair.spawnId, pair.goalId).Build(options, fields[i]);
+    });
+
+    std::vector<bool> result(pairs.size());
+    for(size_t i = 0; i < pairs.size(); ++i)
+    {
+        result[i] = built[i] != 0;
+        if(!result[i])
+            continue;
+
+        FieldHandle handle = ResolveField(GetFieldId(pairs[i].spawnId, pairs[i].goalId));
+        tileData.vectorFields[handle.index] = std::move(fields[i]);
+    }
+    ++fieldVersion;
+
+    // Everything is up to date
+    dirtyArea.reset();
+
+    return result;
+}
+
+void Navigation::RepairFlowFields()
+{
+    if(!dirtyArea)
+        return;
+
+    const TileArea area = *dirtyArea;
+    dirtyArea.reset();
+    ++fieldVersion;
+
+    // The tiles around the area may have gained or lost walls as well
+    UpdateWalls(ExpandArea(area, 1, tileData.sizeX, tileData.sizeY));
+    BakeWalls();
+
+    for(const auto& [fieldId, index] : tileData.fieldIndices)
+    {
+        VectorField& field = tileData.vectorFields[index];
+        // Only the portal graph is built up front, so just start over
+        if(field.sectors)
+        {
+            VectorField rebuilt;
+            FlowFieldBuilder(*this, (uint32_t)fieldId >> 16, (uint32_t)fieldId & 0xFFFF)
+                .Build(field.options, rebuilt);
+            field = std::move(rebuilt);
+            continue;
+        }
+        if(field.walkers.empty())
+            continue;
+
+        FlowFieldRepairer(*this, (uint32_t)fieldId >> 16, (uint32_t)fieldId & 0xFFFF)
+            .Repair(area, field);
+    }
+}
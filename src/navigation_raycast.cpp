@@ -0,0 +1,117 @@
+#include "navigation.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// Grid traversal as described by Amanatides and Woo in "A Fast Voxel Traversal Algorithm for Ray
+// Tracing". The ray visits every tile it passes through in order, so it stops at the first wall
+// instead of testing every wall or entity along the way.
+
+Navigation::RaycastHit Navigation::Raycast(Vector2 from, Vector2 to) const
+{
+    // Tile (x, y) covers [x; x + 1) in these coordinates, see GetTileSpace
+    const float scale = 1.0f / tileSize;
+    const Vector2 start = {
+        .x = (from.x - offsetX) * scale + 0.5f,
+        .y = (from.y - offsetY) * scale + 0.5f,
+    };
+    const Vector2 end = {
+        .x = (to.x - offsetX) * scale + 0.5f,
+        .y = (to.y - offsetY) * scale + 0.5f,
+    };
+    const Vector2 delta = Vector2Subtract(end, start);
+
+    int64_t x = (int64_t)std::floor(start.x);
+    int64_t y = (int64_t)std::floor(start.y);
+    if(!IsReachable(x, y))
+        return {.hit = true, .position = from, .fraction = 0.0f, .side = Tile::Side::NONE};
+
+    const int64_t endX = (int64_t)std::floor(end.x);
+    const int64_t endY = (int64_t)std::floor(end.y);
+    const int64_t stepX = delta.x > 0.0f ? 1 : -1;
+    const int64_t stepY = delta.y > 0.0f ? 1 : -1;
+
+    // How much of the ray it takes to cross one tile along each axis, and how far along the ray
+    // the next tile border along each axis is
+    constexpr float NEVER = std::numeric_limits<float>::infinity();
+    const float tDeltaX = delta.x != 0.0f ? std::abs(1.0f / delta.x) : NEVER;
+    const float tDeltaY = delta.y != 0.0f ? std::abs(1.0f / delta.y) : NEVER;
+    float tMaxX = delta.x == 0.0f ? NEVER
+                  : delta.x > 0.0f ? ((float)x + 1.0f - start.x) * tDeltaX
+                                   : (start.x - (float)x) * tDeltaX;
+    float tMaxY = delta.y == 0.0f ? NEVER
+                  : delta.y > 0.0f ? ((float)y + 1.0f - start.y) * tDeltaY
+                                   : (start.y - (float)y) * tDeltaY;
+
+    while(x != endX || y != endY)
+    {
+        const bool alongX = tMaxX < tMaxY;
+        const float t = alongX ? tMaxX : tMaxY;
+        // Rounding can make the ray miss the end tile by a hair
+        if(t > 1.0f)
+            break;
+
+        const Tile::Side side = alongX ? (stepX > 0 ? Tile::Side::RIGHT : Tile::Side::LEFT)
+                                       : (stepY > 0 ? Tile::Side::BOTTOM : Tile::Side::TOP);
+        const int64_t nextX = alongX ? x + stepX : x;
+        const int64_t nextY = alongX ? y : y + stepY;
+
+        // Walls are only there once BuildWalls has run, unreachable tiles always block
+        const Tile tile = tileData.tiles[GetIndex((uint32_t)x, (uint32_t)y)];
+        if((tile.GetWallSides() & (int)side) != 0 || !IsReachable(nextX, nextY))
+        {
+            return {
+                .hit = true,
+                .position = Vector2Lerp(from, to, t),
+                .fraction = t,
+                .tileX = (uint32_t)x,
+                .tileY = (uint32_t)y,
+                .side = side,
+            };
+        }
+
+        x = nextX;
+        y = nextY;
+        if(alongX)
+            tMaxX += tDeltaX;
+        else
+            tMaxY += tDeltaY;
+    }
+
+    return {
+        .hit = false,
+        .position = to,
+        .fraction = 1.0f,
+        .tileX = (uint32_t)x,
+        .tileY = (uint32_t)y,
+        .side = Tile::Side::NONE,
+    };
+}
+
+void Navigation::Raycast(
+    std::span<const Vector2> from,
+    std::span<const Vector2> to,
+    std::span<RaycastHit> hits) const
+{
+    assert(from.size() == to.size());
+    assert(from.size() == hits.size());
+
+    for(size_t i = 0; i < from.size(); ++i)
+        hits[i] = Raycast(from[i], to[i]);
+}
+
+bool Navigation::HasLineOfSight(Vector2 from, Vector2 to) const
+{
+    return !Raycast(from, to).hit;
+}
+
+void Navigation::HasLineOfSight(
+    Vector2 from,
+    std::span<const Vector2> targets,
+    std::vector<bool>& visible) const
+{
+    visible.resize(targets.size());
+    for(size_t i = 0; i < targets.size(); ++i)
+        visible[i] = HasLineOfSight(from, targets[i]);
+}
@@ -0,0 +1,432 @@
+#include "navigation_sector_field.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <queue>
+#include <tuple>
+
+std::shared_ptr<Navigation::SectorField> Navigation::SectorField::Build(
+    const Navigation& navigation,
+    uint32_t spawnId,
+    uint32_t goalId)
+{
+    auto field = std::make_shared<SectorField>(navigation, spawnId, goalId);
+    field->FindPortals(navigation);
+    if(!field->CalculatePortalCosts(navigation))
+        return nullptr;
+
+    return field;
+}
+
+Navigation::SectorField::SectorField(
+    const Navigation& navigation,
+    uint32_t spawnId,
+    uint32_t goalId)
+    : spawnId(spawnId)
+    , goalId(goalId)
+    , sizeX(navigation.GetSizeX())
+    , sizeY(navigation.GetSizeY())
+    , sectorsX((sizeX + SECTOR_SIZE - 1) / SECTOR_SIZE)
+    , sectorsY((sizeY + SECTOR_SIZE - 1) / SECTOR_SIZE)
+    , sectorPortals((size_t)sectorsX * sectorsY)
+    , sectorHasGoal((size_t)sectorsX * sectorsY, false)
+    , sectorVectors((size_t)sectorsX * sectorsY)
+    , sectorReady(std::make_unique<std::atomic<bool>[]>((size_t)sectorsX * sectorsY))
+{
+}
+
+Vector2 Navigation::SectorField::GetForce(const Navigation& navigation, uint32_t x, uint32_t y)
+    const
+{
+    assert(x < sizeX && y < sizeY);
+
+    const uint32_t sector = GetSector(x, y);
+    if(!sectorReady[sector].load(std::memory_order_acquire))
+    {
+        std::lock_guard lock(buildMutex);
+        if(!sectorReady[sector].load(std::memory_order_relaxed))
+        {
+            BuildSector(navigation, sector);
+            sectorReady[sector].store(true, std::memory_order_release);
+        }
+    }
+
+    const TileArea area = GetSectorArea(sector);
+    return sectorVectors[sector][(y - area.minY) * (area.maxX - area.minX) + (x - area.minX)];
+}
+
+uint32_t Navigation::SectorField::GetSectorCount() const
+{
+    return sectorsX * sectorsY;
+}
+
+uint32_t Navigation::SectorField::GetBuiltSectorCount() const
+{
+    uint32_t count = 0;
+    for(uint32_t sector = 0; sector < sectorsX * sectorsY; ++sector)
+    {
+        if(sectorReady[sector].load(std::memory_order_relaxed))
+            count++;
+    }
+    return count;
+}
+
+const std::vector<Navigation::SectorField::Portal>& Navigation::SectorField::GetPortals() const
+{
+    return portals;
+}
+
+bool Navigation::SectorField::IsPassable(const Navigation& navigation, int64_t x, int64_t y) const
+{
+    return navigation.IsPassable(spawnId, goalId, x, y);
+}
+
+bool Navigation::SectorField::IsGoal(const Navigation& navigation, int64_t x, int64_t y) const
+{
+    return navigation.IsGoal(x, y) && goalId < MAX_GOAL_ID
+           && (navigation.GetIds(x, y) & (1u << goalId)) != 0;
+}
+
+uint32_t Navigation::SectorField::GetSector(uint32_t x, uint32_t y) const
+{
+    return (y / SECTOR_SIZE) * sectorsX + x / SECTOR_SIZE;
+}
+
+Navigation::TileArea Navigation::SectorField::GetSectorArea(uint32_t sector) const
+{
+    const uint32_t minX = (sector % sectorsX) * SECTOR_SIZE;
+    const uint32_t minY = (sector / sectorsX) * SECTOR_SIZE;
+    return {
+        .minX = minX,
+        .minY = minY,
+        .maxX = std::min(minX + SECTOR_SIZE, sizeX),
+        .maxY = std::min(minY + SECTOR_SIZE, sizeY),
+    };
+}
+
+void Navigation::SectorField::FindPortals(const Navigation& navigation)
+{
+    // Every stretch of tiles that is open on both sides of a sector border becomes one portal
+    auto addRuns = [&](uint32_t sectorA, uint32_t sectorB, bool horizontal, uint32_t edge) {
+        const TileArea area = GetSectorArea(sectorA);
+        const uint32_t start = horizontal ? area.minX : area.minY;
+        const uint32_t end = horizontal ? area.maxX : area.maxY;
+
+        std::optional<uint32_t> runStart;
+        for(uint32_t i = start; i <= end; ++i)
+        {
+            bool open = false;
+            if(i < end)
+            {
+                open = horizontal
+                           ? IsPassable(navigation, i, edge) && IsPassable(navigation, i, edge + 1)
+                           : IsPassable(navigation, edge, i) && IsPassable(navigation, edge + 1, i);
+            }
+
+            if(open && !runStart)
+                runStart = i;
+            else if(!open && runStart)
+            {
+                const auto index = (uint32_t)portals.size();
+                portals.push_back({
+                    .sectorA = sectorA,
+                    .sectorB = sectorB,
+                    .horizontal = horizontal,
+                    .edge = edge,
+                    .start = *runStart,
+                    .end = i,
+                    .costs = {NO_PATH, NO_PATH},
+                });
+                sectorPortals[sectorA].push_back(index);
+                sectorPortals[sectorB].push_back(index);
+                runStart.reset();
+            }
+        }
+    };
+
+    for(uint32_t sy = 0; sy < sectorsY; ++sy)
+    {
+        for(uint32_t sx = 0; sx < sectorsX; ++sx)
+        {
+            const uint32_t sector = sy * sectorsX + sx;
+            if(sx + 1 < sectorsX)
+                addRuns(sector, sector + 1, false, (sx + 1) * SECTOR_SIZE - 1);
+            if(sy + 1 < sectorsY)
+                addRuns(sector, sector + sectorsX, true, (sy + 1) * SECTOR_SIZE - 1);
+        }
+    }
+}
+
+bool Navigation::SectorField::CalculatePortalCosts(const Navigation& navigation)
+{
+    // Each side of a portal is a node in the graph, {cost, portal index, side}
+    using OpenPortal = std::tuple<uint32_t, uint32_t, uint32_t>;
+    std::priority_queue<OpenPortal, std::vector<OpenPortal>, std::greater<OpenPortal>> openList;
+    auto relax = [&](uint32_t portalIndex, uint32_t side, uint32_t cost) {
+        uint32_t& portalCost = portals[portalIndex].costs[side];
+        if(cost < portalCost)
+        {
+            portalCost = cost;
+            openList.push({cost, portalIndex, side});
+        }
+    };
+
+    // Distances are measured to the middle of the portal. Using the closest tile instead makes
+    // portals that share a corner look like they are right next to each other
+    auto centerDistance = [&](const std::vector<uint32_t>& distances,
+                              const Portal& portal,
+                              uint32_t sector) {
+        const TileArea area = GetSectorArea(sector);
+        const auto [x, y] = GetPortalCenter(portal, sector);
+        return distances[(y - area.minY) * (area.maxX - area.minX) + (x - area.minX)];
+    };
+
+    // Portals in the same sector as the goal get their cost straight away
+    for(uint32_t sector = 0; sector < sectorsX * sectorsY; ++sector)
+    {
+        const TileArea area = GetSectorArea(sector);
+        std::vector<std::pair<uint32_t, uint32_t>> goals;
+        for(uint32_t y = area.minY; y < area.maxY; ++y)
+        {
+            for(uint32_t x = area.minX; x < area.maxX; ++x)
+            {
+                if(IsGoal(navigation, x, y))
+                    goals.push_back({x, y});
+            }
+        }
+
+        if(goals.empty())
+            continue;
+
+        sectorHasGoal[sector] = true;
+        const std::vector<uint32_t> distances = SectorDistances(navigation, sector, goals);
+        for(uint32_t portalIndex : sectorPortals[sector])
+        {
+            const Portal& portal = portals[portalIndex];
+            const uint32_t distance = centerDistance(distances, portal, sector);
+            if(distance != NO_PATH)
+                relax(portalIndex, GetSide(portal, sector), distance);
+        }
+    }
+
+    if(std::find(sectorHasGoal.begin(), sectorHasGoal.end(), true) == sectorHasGoal.end())
+        return false;
+
+    // Then Dijkstras over the portal graph. Stepping through a portal costs one step, and two
+    // portals are connected if they share a sector, the cost being the number of steps between
+    // them inside that sector
+    while(!openList.empty())
+    {
+        const auto [cost, portalIndex, side] = openList.top();
+        openList.pop();
+
+        const Portal& portal = portals[portalIndex];
+        if(cost != portal.costs[side])
+            continue;
+
+        relax(portalIndex, 1 - side, cost + 1);
+
+        const uint32_t sector = side == 0 ? portal.sectorA : portal.sectorB;
+        const std::vector<uint32_t> distances =
+            SectorDistances(navigation, sector, {GetPortalCenter(portal, sector)});
+        for(uint32_t otherIndex : sectorPortals[sector])
+        {
+            if(otherIndex == portalIndex)
+                continue;
+
+            const Portal& other = portals[otherIndex];
+            const uint32_t distance = centerDistance(distances, other, sector);
+            if(distance != NO_PATH)
+                relax(otherIndex, GetSide(other, sector), cost + distance);
+        }
+    }
+
+    return true;
+}
+
+std::vector<uint32_t> Navigation::SectorField::SectorDistances(
+    const Navigation& navigation,
+    uint32_t sector,
+    const std::vector<std::pair<uint32_t, uint32_t>>& sources) const
+{
+    const TileArea area = GetSectorArea(sector);
+    const uint32_t width = area.maxX - area.minX;
+    const uint32_t height = area.maxY - area.minY;
+    auto localIndex = [&](uint32_t x, uint32_t y) {
+        return (size_t)(y - area.minY) * width + (x - area.minX);
+    };
+
+    std::vector<uint32_t> distances((size_t)width * height, NO_PATH);
+    std::deque<std::pair<uint32_t, uint32_t>> openList;
+    for(const auto& [x, y] : sources)
+    {
+        distances[localIndex(x, y)] = 0;
+        openList.push_back({x, y});
+    }
+
+    while(!openList.empty())
+    {
+        const auto [x, y] = openList.front();
+        openList.pop_front();
+        const uint32_t distance = distances[localIndex(x, y)];
+
+        const std::array<std::pair<int64_t, int64_t>, 4> neighbours = {{
+            {x, (int64_t)y - 1},
+            {x, (int64_t)y + 1},
+            {(int64_t)x - 1, y},
+            {(int64_t)x + 1, y},
+        }};
+        for(const auto& [nx, ny] : neighbours)
+        {
+            if(nx < area.minX || ny < area.minY || nx >= area.maxX || ny >= area.maxY)
+                continue;
+            if(!IsPassable(navigation, nx, ny))
+                continue;
+
+            uint32_t& nDistance = distances[localIndex(nx, ny)];
+            if(nDistance != NO_PATH)
+                continue;
+
+            nDistance = distance + 1;
+            openList.push_back({(uint32_t)nx, (uint32_t)ny});
+        }
+    }
+
+    return distances;
+}
+
+void Navigation::SectorField::BuildSector(const Navigation& navigation, uint32_t sector) const
+{
+    // Integration field over the sector plus a one tile border. The border tiles in the portals
+    // are seeded with the portal costs, so walking downhill leads out through the best portal
+    const TileArea area = GetSectorArea(sector);
+    const int64_t width = (int64_t)(area.maxX - area.minX) + 2;
+    const int64_t height = (int64_t)(area.maxY - area.minY) + 2;
+    auto localIndex = [&](int64_t x, int64_t y) {
+        return (size_t)((y - area.minY + 1) * width + (x - area.minX + 1));
+    };
+    auto isInside = [&](int64_t x, int64_t y) {
+        return x >= area.minX && y >= area.minY && x < area.maxX && y < area.maxY;
+    };
+
+    std::vector<uint32_t> costs((size_t)(width * height), NO_PATH);
+
+    using OpenTile = std::pair<uint32_t, std::pair<int64_t, int64_t>>;
+    std::priority_queue<OpenTile, std::vector<OpenTile>, std::greater<OpenTile>> openList;
+    auto seed = [&](int64_t x, int64_t y, uint32_t cost) {
+        if(cost < costs[localIndex(x, y)])
+        {
+            costs[localIndex(x, y)] = cost;
+            openList.push({cost, {x, y}});
+        }
+    };
+
+    if(sectorHasGoal[sector])
+    {
+        for(uint32_t y = area.minY; y < area.maxY; ++y)
+        {
+            for(uint32_t x = area.minX; x < area.maxX; ++x)
+            {
+                if(IsGoal(navigation, x, y))
+                    seed(x, y, 0);
+            }
+        }
+    }
+
+    for(uint32_t portalIndex : sectorPortals[sector])
+    {
+        // Seed the tiles on the other side with the cost from that side. The costs are from the
+        // middle of the portal, so add the steps along the portal to get there. Seeding every
+        // tile with the same cost makes neighbouring sectors disagree and send agents back and
+        // forth between them
+        const Portal& portal = portals[portalIndex];
+        const uint32_t otherSector = portal.sectorA == sector ? portal.sectorB : portal.sectorA;
+        const uint32_t cost = portal.costs[GetSide(portal, otherSector)];
+        if(cost == NO_PATH)
+            continue;
+
+        const uint32_t center = (portal.start + portal.end) / 2;
+        ForEachPortalTile(portal, otherSector, [&](uint32_t x, uint32_t y) {
+            const uint32_t along = portal.horizontal ? x : y;
+            seed(x, y, cost + (along > center ? along - center : center - along));
+        });
+    }
+
+    while(!openList.empty())
+    {
+        const auto [cost, position] = openList.top();
+        const auto [x, y] = position;
+        openList.pop();
+        if(cost != costs[localIndex(x, y)])
+            continue;
+
+        const std::array<std::pair<int64_t, int64_t>, 4> neighbours = {{
+            {x, y - 1},
+            {x, y + 1},
+            {x - 1, y},
+            {x + 1, y},
+        }};
+        for(const auto& [nx, ny] : neighbours)
+        {
+            if(!isInside(nx, ny) || !IsPassable(navigation, nx, ny))
+                continue;
+
+            if(cost + 1 < costs[localIndex(nx, ny)])
+            {
+                costs[localIndex(nx, ny)] = cost + 1;
+                openList.push({cost + 1, {nx, ny}});
+            }
+        }
+    }
+
+    std::vector<Vector2>& vectors = sectorVectors[sector];
+    vectors.assign((size_t)(area.maxX - area.minX) * (area.maxY - area.minY), Vector2Zero());
+    Vector2* vector = vectors.data();
+    for(int64_t y = area.minY; y < area.maxY; ++y)
+    {
+        for(int64_t x = area.minX; x < area.maxX; ++x, ++vector)
+        {
+            if(!IsPassable(navigation, x, y))
+            {
+                // Same as the walker fields, push anything that wanders off the map back onto it
+                Vector2 toMap = Vector2Zero();
+                for(int64_t ry = -1; ry <= 1; ++ry)
+                {
+                    for(int64_t rx = -1; rx <= 1; ++rx)
+                    {
+                        if((rx != 0 || ry != 0) && navigation.IsReachable(x + rx, y + ry))
+                            toMap = Vector2Add(toMap, {(float)rx, (float)ry});
+                    }
+                }
+                *vector = Vector2Normalize(toMap);
+                continue;
+            }
+
+            // Head for the cheapest neighbour, diagonals included as long as no corner is cut
+            uint32_t bestCost = costs[localIndex(x, y)];
+            Vector2 best = Vector2Zero();
+            for(int64_t ry = -1; ry <= 1; ++ry)
+            {
+                for(int64_t rx = -1; rx <= 1; ++rx)
+                {
+                    if(rx == 0 && ry == 0)
+                        continue;
+                    if(rx != 0 && ry != 0
+                       && (costs[localIndex(x + rx, y)] == NO_PATH
+                           || costs[localIndex(x, y + ry)] == NO_PATH))
+                        continue;
+
+                    const uint32_t cost = costs[localIndex(x + rx, y + ry)];
+                    if(cost < bestCost)
+                    {
+                        bestCost = cost;
+                        best = {(float)rx, (float)ry};
+                    }
+                }
+            }
+
+            *vector = Vector2Normalize(best);
+        }
+    }
+}
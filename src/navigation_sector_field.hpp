@@ -0,0 +1,132 @@
+#pragma once
+
+#include "navigation.hpp"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+// Hierarchical alternative to a full-map vector field, meant for maps that are too large to bake
+// one field per spawn/goal pair for. The grid is split into SECTOR_SIZE x SECTOR_SIZE sectors that
+// are connected through portals, the open stretches of tiles along the sector borders. Only the
+// portal graph and the cost from each portal to the goal is built up front. The vectors of a sector
+// are built the first time a force is asked for inside it.
+class Navigation::SectorField
+{
+  public:
+    static constexpr uint32_t SECTOR_SIZE = 16;
+
+    struct Portal
+    {
+        // Sector `sectorA` is above or to the left of `sectorB`
+        uint32_t sectorA;
+        uint32_t sectorB;
+        // If true, the portal is a stretch along x with sector A's tiles at y = `edge` and sector
+        // B's at y = `edge` + 1. Otherwise the same thing along y
+        bool horizontal;
+        uint32_t edge;
+        // [start; end) along the edge
+        uint32_t start;
+        uint32_t end;
+        // Number of steps to the goal from the middle of the portal, on sector A's side and on
+        // sector B's side
+        uint32_t costs[2];
+    };
+
+    // Returns nullptr if the goal can't be found
+    static std::shared_ptr<SectorField> Build(
+        const Navigation& navigation,
+        uint32_t spawnId,
+        uint32_t goalId);
+
+    SectorField(const Navigation& navigation, uint32_t spawnId, uint32_t goalId);
+
+    // Safe to call from several threads at once
+    Vector2 GetForce(const Navigation& navigation, uint32_t x, uint32_t y) const;
+
+    uint32_t GetSectorCount() const;
+    uint32_t GetBuiltSectorCount() const;
+    const std::vector<Portal>& GetPortals() const;
+
+    // Only visits sectors that have been built
+    template<typename Func>
+    void ForEachBuiltVector(const Func& func) const
+    {
+        std::lock_guard lock(buildMutex);
+        for(uint32_t sector = 0; sector < sectorsX * sectorsY; ++sector)
+        {
+            if(!sectorReady[sector].load(std::memory_order_relaxed))
+                continue;
+
+            const auto [minX, minY, maxX, maxY] = GetSectorArea(sector);
+            const Vector2* vector = sectorVectors[sector].data();
+            for(uint32_t y = minY; y < maxY; ++y)
+            {
+                for(uint32_t x = minX; x < maxX; ++x, ++vector)
+                    func(x, y, *vector);
+            }
+        }
+    }
+
+  private:
+    static constexpr uint32_t NO_PATH = std::numeric_limits<uint32_t>::max();
+
+    const uint32_t spawnId;
+    const uint32_t goalId;
+    const uint32_t sizeX;
+    const uint32_t sizeY;
+    const uint32_t sectorsX;
+    const uint32_t sectorsY;
+
+    std::vector<Portal> portals;
+    // Indices into `portals` for every sector
+    std::vector<std::vector<uint32_t>> sectorPortals;
+    std::vector<bool> sectorHasGoal;
+
+    // Sectors are built lazily from GetForce, which is const
+    mutable std::mutex buildMutex;
+    mutable std::vector<std::vector<Vector2>> sectorVectors;
+    mutable std::unique_ptr<std::atomic<bool>[]> sectorReady;
+
+    bool IsPassable(const Navigation& navigation, int64_t x, int64_t y) const;
+    bool IsGoal(const Navigation& navigation, int64_t x, int64_t y) const;
+    uint32_t GetSector(uint32_t x, uint32_t y) const;
+    TileArea GetSectorArea(uint32_t sector) const;
+
+    // Calls func(x, y) for each tile of the portal that lies inside the given sector
+    template<typename Func>
+    void ForEachPortalTile(const Portal& portal, uint32_t sector, const Func& func) const
+    {
+        const uint32_t edge = sector == portal.sectorA ? portal.edge : portal.edge + 1;
+        for(uint32_t i = portal.start; i < portal.end; ++i)
+        {
+            if(portal.horizontal)
+                func(i, edge);
+            else
+                func(edge, i);
+        }
+    }
+
+    // 0 for sector A's side of the portal, 1 for sector B's
+    static uint32_t GetSide(const Portal& portal, uint32_t sector)
+    {
+        return sector == portal.sectorA ? 0 : 1;
+    }
+
+    std::pair<uint32_t, uint32_t> GetPortalCenter(const Portal& portal, uint32_t sector) const
+    {
+        const uint32_t edge = sector == portal.sectorA ? portal.edge : portal.edge + 1;
+        const uint32_t center = (portal.start + portal.end) / 2;
+        return portal.horizontal ? std::pair{center, edge} : std::pair{edge, center};
+    }
+
+    void FindPortals(const Navigation& navigation);
+    bool CalculatePortalCosts(const Navigation& navigation);
+    // Steps from the given tiles to every tile in the sector, NO_PATH if there is no way
+    std::vector<uint32_t> SectorDistances(
+        const Navigation& navigation,
+        uint32_t sector,
+        const std::vector<std::pair<uint32_t, uint32_t>>& sources) const;
+    void BuildSector(const Navigation& navigation, uint32_t sector) const;
+};
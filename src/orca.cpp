@@ -0,0 +1,360 @@
+#include "orca.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+// Follows the reference implementation, RVO2, except for walls which are a lot simpler than its
+// obstacles
+namespace
+{
+    constexpr float EPSILON = 0.00001f;
+
+    // Every velocity to the left of the line, looking along the direction, is allowed
+    struct Line
+    {
+        Vector2 point;
+        Vector2 direction;
+    };
+
+    float Det(Vector2 a, Vector2 b)
+    {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    // Finds the best velocity on lines[lineIndex] that is inside the maxSpeed circle and allowed
+    // by all lines before it. Along the direction of `preferred` if optimizeDirection is set,
+    // otherwise as close to `preferred` as possible
+    bool LinearProgram1(
+        std::span<const Line> lines,
+        size_t lineIndex,
+        float maxSpeed,
+        Vector2 preferred,
+        bool optimizeDirection,
+        Vector2& result)
+    {
+        const Line& line = lines[lineIndex];
+        const float dotProduct = Vector2DotProduct(line.point, line.direction);
+        const float discriminant = dotProduct * dotProduct + maxSpeed * maxSpeed
+                                   - Vector2DotProduct(line.point, line.point);
+        // The line is entirely outside of the circle
+        if(discriminant < 0.0f)
+            return false;
+
+        const float sqrtDiscriminant = std::sqrt(discriminant);
+        float tLeft = -dotProduct - sqrtDiscriminant;
+        float tRight = -dotProduct + sqrtDiscriminant;
+
+        for(size_t i = 0; i < lineIndex; ++i)
+        {
+            const float denominator = Det(line.direction, lines[i].direction);
+            const float numerator =
+                Det(lines[i].direction, Vector2Subtract(line.point, lines[i].point));
+
+            if(std::abs(denominator) <= EPSILON)
+            {
+                // Parallel, either line i allows all of this line or none of it
+                if(numerator < 0.0f)
+                    return false;
+                continue;
+            }
+
+            const float t = numerator / denominator;
+            if(denominator >= 0.0f)
+                tRight = std::min(tRight, t);
+            else
+                tLeft = std::max(tLeft, t);
+
+            if(tLeft > tRight)
+                return false;
+        }
+
+        float t;
+        if(optimizeDirection)
+        {
+            t = Vector2DotProduct(preferred, line.direction) > 0.0f ? tRight : tLeft;
+        }
+        else
+        {
+            t = std::clamp(
+                Vector2DotProduct(line.direction, Vector2Subtract(preferred, line.point)),
+                tLeft,
+                tRight);
+        }
+
+        result = Vector2Add(line.point, Vector2Scale(line.direction, t));
+        return true;
+    }
+
+    // Returns how many of the lines could be satisfied, lines.size() if all of them. `result` is
+    // the best velocity for those lines
+    size_t LinearProgram2(
+        std::span<const Line> lines,
+        float maxSpeed,
+        Vector2 preferred,
+        bool optimizeDirection,
+        Vector2& result)
+    {
+        if(optimizeDirection)
+            result = Vector2Scale(preferred, maxSpeed);
+        else if(Vector2DotProduct(preferred, preferred) > maxSpeed * maxSpeed)
+            result = Vector2Scale(Vector2Normalize(preferred), maxSpeed);
+        else
+            result = preferred;
+
+        for(size_t i = 0; i < lines.size(); ++i)
+        {
+            if(Det(lines[i].direction, Vector2Subtract(lines[i].point, result)) <= 0.0f)
+                continue;
+
+            const Vector2 previous = result;
+            if(!LinearProgram1(lines, i, maxSpeed, preferred, optimizeDirection, result))
+            {
+                result = previous;
+                return i;
+            }
+        }
+
+        return lines.size();
+    }
+
+    // Used when there is no velocity that satisfies every line, which happens in dense crowds.
+    // Finds the velocity that violates the lines from beginLine and on the least. The first
+    // obstacleLineCount lines are never violated
+    void LinearProgram3(
+        std::span<const Line> lines,
+        size_t obstacleLineCount,
+        size_t beginLine,
+        float maxSpeed,
+        Vector2& result)
+    {
+        float distance = 0.0f;
+        std::array<Line, MAX_ORCA_WALLS + MAX_ORCA_NEIGHBOURS> projectedLines;
+        std::copy_n(lines.begin(), obstacleLineCount, projectedLines.begin());
+
+        for(size_t i = beginLine; i < lines.size(); ++i)
+        {
+            if(Det(lines[i].direction, Vector2Subtract(lines[i].point, result)) <= distance)
+                continue;
+
+            size_t projectedCount = obstacleLineCount;
+            for(size_t j = obstacleLineCount; j < i; ++j)
+            {
+                Line line;
+                const float determinant = Det(lines[i].direction, lines[j].direction);
+                if(std::abs(determinant) <= EPSILON)
+                {
+                    // Parallel and pointing the same way, line i is the stricter of the two
+                    if(Vector2DotProduct(lines[i].direction, lines[j].direction) > 0.0f)
+                        continue;
+
+                    line.point = Vector2Scale(Vector2Add(lines[i].point, lines[j].point), 0.5f);
+                }
+                else
+                {
+                    const float t =
+                        Det(lines[j].direction, Vector2Subtract(lines[i].point, lines[j].point))
+                        / determinant;
+                    line.point = Vector2Add(lines[i].point, Vector2Scale(lines[i].direction, t));
+                }
+
+                line.direction =
+                    Vector2Normalize(Vector2Subtract(lines[j].direction, lines[i].direction));
+                projectedLines[projectedCount++] = line;
+            }
+
+            const Vector2 previous = result;
+            const std::span<const Line> projected(projectedLines.data(), projectedCount);
+            const Vector2 outwards = {-lines[i].direction.y, lines[i].direction.x};
+            // Can only fail because of floating point errors, in which case the last result is
+            // as good as it gets
+            if(LinearProgram2(projected, maxSpeed, outwards, true, result) < projectedCount)
+                result = previous;
+
+            distance = Det(lines[i].direction, Vector2Subtract(lines[i].point, result));
+        }
+    }
+
+    // Keeps the Capacity closest of everything it is given, closest first
+    template<typename T, size_t Capacity>
+    struct Closest
+    {
+        std::array<T, Capacity> items;
+        std::array<float, Capacity> distances;
+        size_t count = 0;
+
+        void Add(const T& item, float distance)
+        {
+            if(count == Capacity && distance >= distances[count - 1])
+                return;
+
+            size_t slot = std::min(count, Capacity - 1);
+            for(; slot > 0 && distances[slot - 1] > distance; --slot)
+            {
+                items[slot] = items[slot - 1];
+                distances[slot] = distances[slot - 1];
+            }
+            items[slot] = item;
+            distances[slot] = distance;
+            count = std::min(count + 1, Capacity);
+        }
+    };
+}
+
+Vector2 GetOrcaVelocity(
+    const NeighbourBatch& neighbours,
+    std::span<const Navigation::Wall> walls,
+    Vector2 position,
+    Vector2 velocity,
+    Vector2 preferredVelocity,
+    float maxSpeed,
+    float radius,
+    float timeHorizon,
+    float wallTimeHorizon,
+    float timeStep)
+{
+    // Walls don't move out of the way, so the agent takes all of the responsibility. Velocities
+    // that would bring it closer to a wall than its radius within wallTimeHorizon are ruled out,
+    // and an agent that is already too close can't get any closer. Standing still is always
+    // allowed, which keeps these lines from ever contradicting each other
+    Closest<Line, MAX_ORCA_WALLS> wallLines;
+    const float inverseWallTimeHorizon = 1.0f / std::max(wallTimeHorizon, timeStep);
+    for(const Navigation::Wall& wall : walls)
+    {
+        const Vector2 along = Vector2Subtract(wall.end, wall.start);
+        const float lengthSquared = Vector2DotProduct(along, along);
+        const float t = lengthSquared > EPSILON
+                            ? std::clamp(
+                                  Vector2DotProduct(Vector2Subtract(position, wall.start), along)
+                                      / lengthSquared,
+                                  0.0f,
+                                  1.0f)
+                            : 0.0f;
+        const Vector2 toAgent =
+            Vector2Subtract(position, Vector2Add(wall.start, Vector2Scale(along, t)));
+        // Behind the wall, it belongs to some other part of the level
+        if(Vector2DotProduct(toAgent, wall.normal) < 0.0f)
+            continue;
+
+        const float distance = Vector2Length(toAgent);
+        const Vector2 away =
+            distance > EPSILON ? Vector2Scale(toAgent, 1.0f / distance) : wall.normal;
+        const float maxApproachSpeed = std::max(distance - radius, 0.0f) * inverseWallTimeHorizon;
+        // Too far away to matter at any speed
+        if(maxApproachSpeed >= maxSpeed)
+            continue;
+
+        wallLines.Add(
+            {
+                .point = Vector2Scale(away, -maxApproachSpeed),
+                .direction = {away.y, -away.x},
+            },
+            distance);
+    }
+
+    // The closest neighbours, closest first. The linear programs treat earlier lines as more
+    // important when not all of them can be satisfied
+    Closest<uint32_t, MAX_ORCA_NEIGHBOURS> closest;
+    for(uint32_t i = 0; i < (uint32_t)neighbours.Size(); ++i)
+        closest.Add(i, neighbours.distance[i]);
+
+    const float inverseTimeHorizon = 1.0f / std::max(timeHorizon, timeStep);
+    const float combinedRadius = radius + radius;
+    const float combinedRadiusSquared = combinedRadius * combinedRadius;
+
+    std::array<Line, MAX_ORCA_WALLS + MAX_ORCA_NEIGHBOURS> lines;
+    std::copy_n(wallLines.items.begin(), wallLines.count, lines.begin());
+    size_t lineCount = wallLines.count;
+    for(size_t n = 0; n < closest.count; ++n)
+    {
+        const uint32_t i = closest.items[n];
+        const Vector2 relativePosition = {
+            .x = neighbours.positionX[i] - position.x,
+            .y = neighbours.positionY[i] - position.y,
+        };
+        const Vector2 relativeVelocity = {
+            .x = velocity.x - neighbours.velocityX[i],
+            .y = velocity.y - neighbours.velocityY[i],
+        };
+        const float distanceSquared = Vector2DotProduct(relativePosition, relativePosition);
+
+        Line line;
+        Vector2 u;
+        if(distanceSquared > combinedRadiusSquared)
+        {
+            // The velocity obstacle is a truncated cone, with the cut-off circle at the time
+            // horizon
+            const Vector2 w = Vector2Subtract(
+                relativeVelocity,
+                Vector2Scale(relativePosition, inverseTimeHorizon));
+            const float wLengthSquared = Vector2DotProduct(w, w);
+            const float dotProduct = Vector2DotProduct(w, relativePosition);
+
+            if(dotProduct < 0.0f
+               && dotProduct * dotProduct > combinedRadiusSquared * wLengthSquared)
+            {
+                // Closest to the cut-off circle
+                const float wLength = std::sqrt(wLengthSquared);
+                const Vector2 unitW = Vector2Scale(w, 1.0f / wLength);
+                line.direction = {unitW.y, -unitW.x};
+                u = Vector2Scale(unitW, combinedRadius * inverseTimeHorizon - wLength);
+            }
+            else
+            {
+                // Closest to one of the legs of the cone
+                const float leg = std::sqrt(distanceSquared - combinedRadiusSquared);
+                if(Det(relativePosition, w) > 0.0f)
+                {
+                    line.direction = Vector2Scale(
+                        {
+                            .x = relativePosition.x * leg - relativePosition.y * combinedRadius,
+                            .y = relativePosition.x * combinedRadius + relativePosition.y * leg,
+                        },
+                        1.0f / distanceSquared);
+                }
+                else
+                {
+                    line.direction = Vector2Scale(
+                        {
+                            .x = relativePosition.x * leg + relativePosition.y * combinedRadius,
+                            .y = -relativePosition.x * combinedRadius + relativePosition.y * leg,
+                        },
+                        -1.0f / distanceSquared);
+                }
+
+                const float legProjection = Vector2DotProduct(relativeVelocity, line.direction);
+                u = Vector2Subtract(Vector2Scale(line.direction, legProjection), relativeVelocity);
+            }
+        }
+        else
+        {
+            // Already overlapping, push apart within one step instead of within the horizon
+            const Vector2 w =
+                Vector2Subtract(relativeVelocity, Vector2Scale(relativePosition, 1.0f / timeStep));
+            const float wLength = Vector2Length(w);
+            // Exactly on top of each other and not moving, there is no way to tell which way is
+            // out. They will be told apart as soon as one of them moves
+            if(wLength <= EPSILON)
+                continue;
+
+            const Vector2 unitW = Vector2Scale(w, 1.0f / wLength);
+            line.direction = {unitW.y, -unitW.x};
+            u = Vector2Scale(unitW, combinedRadius / timeStep - wLength);
+        }
+
+        // Both agents take half of the responsibility
+        line.point = Vector2Add(velocity, Vector2Scale(u, 0.5f));
+        lines[lineCount++] = line;
+    }
+
+    const std::span<const Line> constraints(lines.data(), lineCount);
+    Vector2 result;
+    const size_t satisfied =
+        LinearProgram2(constraints, maxSpeed, preferredVelocity, false, result);
+    if(satisfied < lineCount)
+        LinearProgram3(constraints, wallLines.count, satisfied, maxSpeed, result);
+
+    return result;
+}
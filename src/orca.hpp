@@ -0,0 +1,37 @@
+#pragma once
+
+#include <avoidance.hpp>
+#include <external/raylib.hpp>
+#include <navigation.hpp>
+
+#include <span>
+
+// Optimal reciprocal collision avoidance, https://gamma.cs.unc.edu/ORCA/. Instead of adding forces
+// every neighbour becomes a half-plane of velocities that won't collide with it within the time
+// horizon, assuming the neighbour takes half of the responsibility for avoiding the collision.
+// The new velocity is the one closest to the preferred velocity that is inside all of them, found
+// with a small linear program
+//
+// An alternative to GetAvoidanceForces, see System::AvoidanceModel
+
+// Only this many of the closest neighbours are avoided, the ones further away rarely add a
+// constraint that matters and every constraint makes the linear program more expensive
+constexpr size_t MAX_ORCA_NEIGHBOURS = 10;
+// Same for walls, an agent is rarely close to more than a couple
+constexpr size_t MAX_ORCA_WALLS = 6;
+
+// The velocity closest to preferredVelocity, no faster than maxSpeed, that doesn't collide with
+// any of the neighbours within timeHorizon or any of the walls within wallTimeHorizon. Walls are
+// never walked into, neighbours might be when there is no room. timeStep is how far the simulation
+// steps each frame, which is how quickly neighbours that already overlap are pushed apart
+Vector2 GetOrcaVelocity(
+    const NeighbourBatch& neighbours,
+    std::span<const Navigation::Wall> walls,
+    Vector2 position,
+    Vector2 velocity,
+    Vector2 preferredVelocity,
+    float maxSpeed,
+    float radius,
+    float timeHorizon,
+    float wallTimeHorizon,
+    float timeStep);
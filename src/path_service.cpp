@@ -0,0 +1,355 @@
+#include "path_service.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    // Costs are in tenths of a tile so diagonals can stay integers
+    constexpr uint32_t STRAIGHT_COST = 10;
+    constexpr uint32_t DIAGONAL_COST = 14;
+
+    constexpr std::array<std::array<int64_t, 2>, 8> OFFSETS = {{
+        {0, -1},
+        {0, 1},
+        {-1, 0},
+        {1, 0},
+        {-1, -1},
+        {1, -1},
+        {-1, 1},
+        {1, 1},
+    }};
+
+    // Octile distance, never more than the actual cost
+    uint32_t Estimate(int64_t x, int64_t y, int64_t goalX, int64_t goalY)
+    {
+        const auto dx = (uint32_t)std::abs(goalX - x);
+        const auto dy = (uint32_t)std::abs(goalY - y);
+        return STRAIGHT_COST * std::max(dx, dy)
+               + (DIAGONAL_COST - STRAIGHT_COST) * std::min(dx, dy);
+    }
+
+    bool IsPassable(const Navigation& navigation, int64_t x, int64_t y, uint32_t goalId)
+    {
+        // Spawn ids don't matter for passability
+        return navigation.IsPassable(0, goalId, x, y);
+    }
+}
+
+bool PathService::FindPath(
+    const Navigation& navigation,
+    Vector2 from,
+    Vector2 to,
+    uint32_t goalId,
+    std::vector<Vector2>& path)
+{
+    CheckStale(navigation);
+    path.clear();
+
+    const std::optional<CacheKey> key = GetKey(navigation, from, to, goalId);
+    if(!key)
+        return false;
+
+    const auto iter = cache.find(*key);
+    if(iter == cache.end())
+    {
+        // Takes over the search state, a request that was in progress starts over from Update
+        if(search)
+            pendingRequests.push_front(search->request);
+
+        BeginSearch(navigation, 0, *key);
+        uint32_t budget = UINT32_MAX;
+        const Status status = StepSearch(navigation, budget);
+        search.reset();
+
+        const std::vector<uint32_t>& tiles = AddToCache(
+            *key,
+            status == Status::FOUND ? GetTurningTiles(key->toTile) : std::vector<uint32_t>{});
+        if(tiles.empty())
+            return false;
+
+        BuildPath(navigation, tiles, from, to, path);
+        return true;
+    }
+
+    if(iter->second.empty())
+        return false;
+
+    BuildPath(navigation, iter->second, from, to, path);
+    return true;
+}
+
+PathService::RequestId PathService::Request(Vector2 from, Vector2 to, uint32_t goalId)
+{
+    const RequestId id = nextRequestId++;
+    requests[id] = {.from = from, .to = to, .goalId = goalId, .status = Status::PENDING};
+    pendingRequests.push_back(id);
+    return id;
+}
+
+void PathService::Update(const Navigation& navigation, uint32_t maxExpandedTiles)
+{
+    CheckStale(navigation);
+
+    uint32_t budget = maxExpandedTiles;
+    while(budget > 0 && (search || !pendingRequests.empty()))
+    {
+        if(!search)
+        {
+            const RequestId id = pendingRequests.front();
+            pendingRequests.pop_front();
+
+            auto requestIter = requests.find(id);
+            if(requestIter == requests.end())
+                continue;
+
+            PathRequest& request = requestIter->second;
+            const std::optional<CacheKey> key =
+                GetKey(navigation, request.from, request.to, request.goalId);
+            if(!key)
+            {
+                request.status = Status::NO_PATH;
+                continue;
+            }
+
+            if(auto cached = cache.find(*key); cached != cache.end())
+            {
+                request.status = cached->second.empty() ? Status::NO_PATH : Status::FOUND;
+                if(!cached->second.empty())
+                    BuildPath(navigation, cached->second, request.from, request.to, request.path);
+                continue;
+            }
+
+            BeginSearch(navigation, id, *key);
+        }
+
+        const Status status = StepSearch(navigation, budget);
+        if(status == Status::PENDING)
+            break;
+
+        const std::vector<uint32_t>& tiles = AddToCache(
+            search->key,
+            status == Status::FOUND ? GetTurningTiles(search->key.toTile)
+                                    : std::vector<uint32_t>{});
+        // The request may have been released while it was being searched for
+        if(auto requestIter = requests.find(search->request); requestIter != requests.end())
+        {
+            PathRequest& request = requestIter->second;
+            request.status = status;
+            if(status == Status::FOUND)
+                BuildPath(navigation, tiles, request.from, request.to, request.path);
+        }
+        search.reset();
+    }
+}
+
+PathService::Status PathService::GetStatus(RequestId id) const
+{
+    auto iter = requests.find(id);
+    return iter == requests.end() ? Status::UNKNOWN : iter->second.status;
+}
+
+const std::vector<Vector2>* PathService::GetPath(RequestId id) const
+{
+    auto iter = requests.find(id);
+    if(iter == requests.end() || iter->second.status != Status::FOUND)
+        return nullptr;
+
+    return &iter->second.path;
+}
+
+void PathService::Release(RequestId id)
+{
+    // Left in pendingRequests, Update skips requests that are gone
+    requests.erase(id);
+}
+
+void PathService::CheckStale(const Navigation& navigation)
+{
+    if(navigation.generation == cacheGeneration && navigation.tileVersion == cacheTileVersion)
+        return;
+
+    cacheGeneration = navigation.generation;
+    cacheTileVersion = navigation.tileVersion;
+    cache.clear();
+    if(search)
+    {
+        pendingRequests.push_front(search->request);
+        search.reset();
+    }
+}
+
+const std::vector<uint32_t>& PathService::AddToCache(CacheKey key, std::vector<uint32_t> tiles)
+{
+    if(cache.size() >= MAX_CACHED_PATHS)
+        cache.clear();
+
+    return cache.insert_or_assign(key, std::move(tiles)).first->second;
+}
+
+std::optional<PathService::CacheKey> PathService::GetKey(
+    const Navigation& navigation,
+    Vector2 from,
+    Vector2 to,
+    uint32_t goalId) const
+{
+    const Vector2 fromTile = navigation.GetTileSpace(from);
+    const Vector2 toTile = navigation.GetTileSpace(to);
+    if(!IsPassable(navigation, (int64_t)fromTile.x, (int64_t)fromTile.y, goalId)
+       || !IsPassable(navigation, (int64_t)toTile.x, (int64_t)toTile.y, goalId))
+    {
+        return std::nullopt;
+    }
+
+    return CacheKey{
+        .fromTile = (uint32_t)navigation.GetIndex((uint32_t)fromTile.x, (uint32_t)fromTile.y),
+        .toTile = (uint32_t)navigation.GetIndex((uint32_t)toTile.x, (uint32_t)toTile.y),
+        .goalId = goalId,
+    };
+}
+
+void PathService::BeginSearch(const Navigation& navigation, RequestId request, CacheKey key)
+{
+    const size_t tileCount = (size_t)navigation.GetSizeX() * navigation.GetSizeY();
+    if(costs.size() != tileCount)
+    {
+        costs.assign(tileCount, 0);
+        parents.assign(tileCount, NO_TILE);
+        stamps.assign(tileCount, 0);
+        closed.assign(tileCount, false);
+        searchStamp = 0;
+    }
+
+    // Every stamp is from an earlier search after a wrap, so start over from a clean slate
+    if(++searchStamp == 0)
+    {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        searchStamp = 1;
+    }
+
+    const uint32_t sizeX = navigation.GetSizeX();
+    search = Search{
+        .request = request,
+        .key = key,
+        .goalX = key.toTile % sizeX,
+        .goalY = key.toTile / sizeX,
+    };
+
+    openList.clear();
+    stamps[key.fromTile] = searchStamp;
+    costs[key.fromTile] = 0;
+    parents[key.fromTile] = NO_TILE;
+    closed[key.fromTile] = false;
+    openList.push_back({
+        .estimate =
+            Estimate(key.fromTile % sizeX, key.fromTile / sizeX, search->goalX, search->goalY),
+        .tile = key.fromTile,
+    });
+}
+
+PathService::Status PathService::StepSearch(const Navigation& navigation, uint32_t& budget)
+{
+    assert(search);
+    const uint32_t sizeX = navigation.GetSizeX();
+    const uint32_t goalId = search->key.goalId;
+    // std::push_heap keeps the largest element on top, so the cheapest estimate has to compare
+    // as the largest
+    constexpr auto compare = [](const OpenTile& a, const OpenTile& b) {
+        return a.estimate > b.estimate;
+    };
+
+    while(!openList.empty())
+    {
+        if(budget == 0)
+            return Status::PENDING;
+        --budget;
+
+        std::pop_heap(openList.begin(), openList.end(), compare);
+        const uint32_t tile = openList.back().tile;
+        openList.pop_back();
+        // A tile is pushed again whenever a cheaper way to it is found, skip the old entries
+        if(closed[tile])
+            continue;
+        closed[tile] = true;
+
+        if(tile == search->key.toTile)
+            return Status::FOUND;
+
+        const int64_t x = tile % sizeX;
+        const int64_t y = tile / sizeX;
+        for(const auto [dx, dy] : OFFSETS)
+        {
+            const int64_t nx = x + dx;
+            const int64_t ny = y + dy;
+            if(!IsPassable(navigation, nx, ny, goalId))
+                continue;
+
+            const bool diagonal = dx != 0 && dy != 0;
+            if(diagonal
+               && (!IsPassable(navigation, x + dx, y, goalId)
+                   || !IsPassable(navigation, x, y + dy, goalId)))
+            {
+                continue;
+            }
+
+            const auto neighbour = (uint32_t)navigation.GetIndex((uint32_t)nx, (uint32_t)ny);
+            const uint32_t cost = costs[tile] + (diagonal ? DIAGONAL_COST : STRAIGHT_COST);
+            if(stamps[neighbour] != searchStamp)
+            {
+                stamps[neighbour] = searchStamp;
+                closed[neighbour] = false;
+            }
+            else if(closed[neighbour] || costs[neighbour] <= cost)
+            {
+                continue;
+            }
+
+            costs[neighbour] = cost;
+            parents[neighbour] = tile;
+            openList.push_back({
+                .estimate = cost + Estimate(nx, ny, search->goalX, search->goalY),
+                .tile = neighbour,
+            });
+            std::push_heap(openList.begin(), openList.end(), compare);
+        }
+    }
+
+    return Status::NO_PATH;
+}
+
+std::vector<uint32_t> PathService::GetTurningTiles(uint32_t goalTile) const
+{
+    std::vector<uint32_t> tiles;
+    for(uint32_t tile = goalTile; tile != NO_TILE; tile = parents[tile])
+        tiles.push_back(tile);
+    std::reverse(tiles.begin(), tiles.end());
+
+    // Tiles in the middle of a straight stretch don't change anything
+    std::vector<uint32_t> turning;
+    for(size_t i = 0; i < tiles.size(); ++i)
+    {
+        if(i == 0 || i + 1 == tiles.size()
+           || tiles[i] - tiles[i - 1] != tiles[i + 1] - tiles[i])
+        {
+            turning.push_back(tiles[i]);
+        }
+    }
+    return turning;
+}
+
+void PathService::BuildPath(
+    const Navigation& navigation,
+    const std::vector<uint32_t>& tiles,
+    Vector2 from,
+    Vector2 to,
+    std::vector<Vector2>& path) const
+{
+    const uint32_t sizeX = navigation.GetSizeX();
+
+    path.clear();
+    path.push_back(from);
+    // The first and last tiles are the ones `from` and `to` are in
+    for(size_t i = 1; i + 1 < tiles.size(); ++i)
+        path.push_back(navigation.ConvertToWorldSpace(tiles[i] % sizeX, tiles[i] / sizeX));
+    path.push_back(to);
+}
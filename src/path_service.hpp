@@ -0,0 +1,140 @@
+#pragma once
+
+#include <navigation.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Point-to-point paths over the navigation grid, for anything that needs a route of its own
+// rather than a whole flow field. Paths are found with A* over the 8 neighbours of each tile,
+// without cutting corners past tiles that can't be passed.
+//
+// The search state is kept between searches so that searching doesn't allocate once the grid size
+// has been seen. Requests are worked on a bit at a time from Update so that a burst of requests is
+// spread over several frames, and found paths are cached until the tiles change.
+class PathService
+{
+  public:
+    using RequestId = uint32_t;
+
+    enum class Status
+    {
+        PENDING,
+        FOUND,
+        NO_PATH,
+        // Never requested or already released
+        UNKNOWN,
+    };
+
+    // Finds a path right away. `path` gets `from`, the centre of every tile where the path turns,
+    // and `to`. Tiles are passable the same way as for flow fields towards `goalId`, see
+    // Navigation::IsPassable. Returns false if there is no path
+    bool FindPath(
+        const Navigation& navigation,
+        Vector2 from,
+        Vector2 to,
+        uint32_t goalId,
+        std::vector<Vector2>& path);
+
+    // Same as FindPath but the search is done by Update
+    RequestId Request(Vector2 from, Vector2 to, uint32_t goalId);
+    // Works on pending requests, oldest first, until `maxExpandedTiles` tiles have been expanded
+    void Update(const Navigation& navigation, uint32_t maxExpandedTiles);
+    Status GetStatus(RequestId id) const;
+    // nullptr unless the status is FOUND
+    const std::vector<Vector2>* GetPath(RequestId id) const;
+    // Forgets about the request, pending or not
+    void Release(RequestId id);
+
+  private:
+    static constexpr uint32_t NO_TILE = UINT32_MAX;
+    // The cache is dropped when it grows past this instead of keeping track of what is used
+    static constexpr size_t MAX_CACHED_PATHS = 1024;
+
+    struct PathRequest
+    {
+        Vector2 from;
+        Vector2 to;
+        uint32_t goalId;
+        Status status;
+        std::vector<Vector2> path;
+    };
+
+    struct CacheKey
+    {
+        uint32_t fromTile;
+        uint32_t toTile;
+        uint32_t goalId;
+
+        bool operator==(const CacheKey& other) const = default;
+    };
+
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey& key) const
+        {
+            uint64_t hash = ((uint64_t)key.fromTile << 32) | key.toTile;
+            hash ^= (uint64_t)key.goalId * 0x9e3779b97f4a7c15ull;
+            return std::hash<uint64_t>{}(hash);
+        }
+    };
+
+    struct OpenTile
+    {
+        // Cost so far plus the estimate to the goal
+        uint32_t estimate;
+        uint32_t tile;
+    };
+
+    struct Search
+    {
+        RequestId request;
+        CacheKey key;
+        uint32_t goalX;
+        uint32_t goalY;
+    };
+
+    std::unordered_map<RequestId, PathRequest> requests;
+    std::deque<RequestId> pendingRequests;
+    RequestId nextRequestId = 1;
+
+    // Turning tiles of every path found since the tiles last changed, empty if there was no path.
+    // Kept as tiles so the same path can be reused for any positions within the end tiles
+    std::unordered_map<CacheKey, std::vector<uint32_t>, CacheKeyHash> cache;
+    uint32_t cacheGeneration = 0;
+    uint64_t cacheTileVersion = 0;
+
+    // Per-tile search state. A tile's cost and parent are only valid for the current search if
+    // its stamp matches `searchStamp`, which saves clearing everything before every search
+    std::vector<uint32_t> costs;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> stamps;
+    std::vector<bool> closed;
+    std::vector<OpenTile> openList;
+    uint32_t searchStamp = 0;
+    std::optional<Search> search;
+
+    // Drops the cache and restarts the search in progress if the tiles have changed
+    void CheckStale(const Navigation& navigation);
+    // Clears the cache first if it has grown too large
+    const std::vector<uint32_t>& AddToCache(CacheKey key, std::vector<uint32_t> tiles);
+    std::optional<CacheKey> GetKey(
+        const Navigation& navigation,
+        Vector2 from,
+        Vector2 to,
+        uint32_t goalId) const;
+    void BeginSearch(const Navigation& navigation, RequestId request, CacheKey key);
+    // Returns PENDING if `budget` ran out before the search was done
+    Status StepSearch(const Navigation& navigation, uint32_t& budget);
+    // Turning tiles from the start to the goal of the finished search
+    std::vector<uint32_t> GetTurningTiles(uint32_t goalTile) const;
+    void BuildPath(
+        const Navigation& navigation,
+        const std::vector<uint32_t>& tiles,
+        Vector2 from,
+        Vector2 to,
+        std::vector<Vector2>& path) const;
+};
@@ -0,0 +1,33 @@
+#include "spatial_hash.hpp"
+
+#include <bit>
+#include <cassert>
+
+SpatialHash::SpatialHash(float cellSize)
+    : inverseCellSize(1.0f / cellSize)
+{
+    assert(cellSize > 0.0f);
+}
+
+void SpatialHash::Build(std::span<const Vector2> positions)
+{
+    // Around two buckets per position keeps collisions rare without wasting much memory
+    const auto bucketCount = std::bit_ceil(std::max<uint32_t>((uint32_t)positions.size() * 2, 16));
+    bucketMask = bucketCount - 1;
+
+    // Counting sort by bucket, so every bucket ends up as one contiguous range
+    positionBuckets.resize(positions.size());
+    bucketStarts.assign(bucketCount + 1, 0);
+    for(size_t i = 0; i < positions.size(); ++i)
+    {
+        positionBuckets[i] = GetBucket(GetCell(positions[i].x), GetCell(positions[i].y));
+        ++bucketStarts[positionBuckets[i] + 1];
+    }
+    for(uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+
+    indices.resize(positions.size());
+    nextSlots.assign(bucketStarts.begin(), bucketStarts.end() - 1);
+    for(size_t i = 0; i < positions.size(); ++i)
+        indices[nextSlots[positionBuckets[i]]++] = (uint32_t)i;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <external/raylib.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Uniform grid of points for finding what is close to a position without looking at everything.
+// Cells are hashed into a fixed number of buckets so the grid doesn't need to know the size of
+// the world. Rebuilt from scratch with Build, which is cheap enough to do every frame.
+//
+// Works with indices into whatever array the positions came from, so the caller keeps any other
+// data it needs next to the positions
+class SpatialHash
+{
+  public:
+    // Queries are cheapest with a radius around the cell size
+    explicit SpatialHash(float cellSize);
+
+    // Replaces everything in the hash. Index i refers to positions[i]
+    void Build(std::span<const Vector2> positions);
+
+    // Calls func(index) once for every position within `radius` of `position`. Positions a bit
+    // further away may be visited as well, so the caller still has to check the distance
+    template<typename Func>
+    void ForEachNear(Vector2 position, float radius, const Func& func) const
+    {
+        if(indices.empty())
+            return;
+
+        const int64_t minX = GetCell(position.x - radius);
+        const int64_t maxX = GetCell(position.x + radius);
+        const int64_t minY = GetCell(position.y - radius);
+        const int64_t maxY = GetCell(position.y + radius);
+
+        if((maxX - minX + 1) * (maxY - minY + 1) > (int64_t)MAX_QUERY_BUCKETS)
+        {
+            for(uint32_t index : indices)
+                func(index);
+            return;
+        }
+
+        // Several cells can end up in the same bucket, which must only be visited once
+        std::array<uint32_t, MAX_QUERY_BUCKETS> visited;
+        size_t visitedCount = 0;
+
+        for(int64_t y = minY; y <= maxY; ++y)
+        {
+            for(int64_t x = minX; x <= maxX; ++x)
+            {
+                const uint32_t bucket = GetBucket(x, y);
+                const auto visitedEnd = visited.begin() + visitedCount;
+                if(std::find(visited.begin(), visitedEnd, bucket) != visitedEnd)
+                    continue;
+                visited[visitedCount++] = bucket;
+
+                for(uint32_t i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i)
+                    func(indices[i]);
+            }
+        }
+    }
+
+  private:
+    // Queries covering more cells than this visit everything instead
+    static constexpr size_t MAX_QUERY_BUCKETS = 16;
+
+    float inverseCellSize;
+    uint32_t bucketMask = 0;
+    // indices[bucketStarts[b]; bucketStarts[b + 1]) are in bucket b
+    std::vector<uint32_t> bucketStarts;
+    std::vector<uint32_t> indices;
+    // Only used while building, kept around to save the allocations
+    std::vector<uint32_t> positionBuckets;
+    std::vector<uint32_t> nextSlots;
+
+    int64_t GetCell(float coordinate) const
+    {
+        return (int64_t)std::floor(coordinate * inverseCellSize);
+    }
+
+    uint32_t GetBucket(int64_t cellX, int64_t cellY) const
+    {
+        const auto hash = (uint64_t)cellX * 73856093ull ^ (uint64_t)cellY * 19349663ull;
+        return (uint32_t)hash & bucketMask;
+    }
+};
@@ -1,9 +1,20 @@
+#pragma once
+
 #include <entt/entt.hpp>
 #include <external/raylib.hpp>
+
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include <avoidance.hpp>
+#include <crowd_density.hpp>
+#include <navigation.hpp>
+#include <orca.hpp>
 #include <profiling.hpp>
+#include <spatial_hash.hpp>
+#include <thread_pool.hpp>
 
 #include <component/acceleration.hpp>
 #include <component/health.hpp>
@@ -11,137 +22,375 @@
 #include <component/transform.hpp>
 #include <component/velocity.hpp>
 
-std::optional<float> TimeToCollisionSphere(
-    const Vector2 position,
-    const Vector2 otherPosition,
-    const Vector2 velocity,
-    const Vector2 otherVelocity,
-    const float radius)
-{
-    float totalRadius = radius + radius;
-    float radiusSquared = totalRadius * totalRadius;
-
-    float distanceSquared = Vector2DistanceSqr(position, otherPosition);
-    if(distanceSquared < radiusSquared)
-        return 0.0f;
-
-    Vector2 relPos = Vector2Subtract(otherPosition, position);
-    Vector2 relVel = Vector2Subtract(velocity, otherVelocity);
-
-    float a = Vector2DotProduct(relVel, relVel);
-    float b = Vector2DotProduct(relPos, relVel);
-    float c = Vector2DotProduct(relPos, relPos) - radiusSquared;
-
-    float disc = b * b - a * c;
-    if(disc < 0.0f || a <= 0.0f)
-        return std::nullopt;
-
-    float t = (b - std::sqrt(disc)) / a;
-
-    if(t <= 0.0f)
-        return std::nullopt;
-
-    return t;
-}
+#include <system/avoid_obstacles.hpp>
+#include <system/for_each_agent.hpp>
 
 namespace System
 {
-    void AvoidEntities(entt::registry& registry, float ksi, float avoidanceT, float time)
+    // How agents keep away from each other and from walls, Navigation.avoidanceModel in Lua
+    enum class AvoidanceModel
     {
-        for(auto [entity, transform, moveTowards, velocityComponent, acceleration] :
-            registry
-                .view<
-                    Component::Transform,
-                    Component::MoveTowards,
-                    Component::Velocity,
-                    Component::Acceleration>()
-                .each())
+        // Predictive forces, see AvoidEntities and AvoidObstacles
+        FORCES,
+        // Reciprocal velocity obstacles, see AvoidEntitiesOrca
+        ORCA,
+        // Predictive forces from the closest few, and away from where it is crowded for the rest,
+        // see CrowdDensity. Made for swarms too large to look at every neighbour
+        DENSITY,
+    };
+
+    // Where everything that can be avoided is, gathered once per frame so every agent only has to
+    // look at the others close to it. Also used by SteerAgents
+    class EntityAvoidance
+    {
+      public:
+        void Gather(entt::registry& registry)
         {
-            PROFILE_SCOPE((ENTT_ID_TYPE)entity);
+            others.clear();
+            otherPositions.clear();
+            for(auto [otherEntity, otherTransform, otherHealth] :
+                registry.view<Component::Transform, Component::Health>().each())
+            {
+                Vector2 otherVelocity = Vector2Zero();
+                if(Component::Velocity* oVel = registry.try_get<Component::Velocity>(otherEntity);
+                   oVel)
+                {
+                    otherVelocity = {.x = oVel->ToVector3().x, .y = oVel->ToVector3().z};
+                }
+
+                others.push_back({
+                    .entity = otherEntity,
+                    .position = otherTransform.position,
+                    .velocity = otherVelocity,
+                });
+                otherPositions.push_back({otherTransform.position.x, otherTransform.position.z});
+            }
+            spatialHash.Build(otherPositions);
+        }
 
-            const float radius = 0.30f;
+        // Builds the crowd density of every agent, for GetCrowdForce. Has to be called after
+        // Gather
+        void GatherCrowd(entt::registry& registry, const Navigation& navigation)
+        {
+            crowdPositions.clear();
+            crowdVelocities.clear();
+            for(auto [agent, transform, moveTowards, velocity] :
+                registry.view<Component::Transform, Component::MoveTowards, Component::Velocity>()
+                    .each())
+            {
+                crowdPositions.push_back({transform.position.x, transform.position.z});
+                crowdVelocities.push_back({velocity.x, velocity.z});
+            }
+            crowdDensity.Build(navigation, crowdPositions, crowdVelocities);
+            closeSpatialHash.Build(otherPositions);
+        }
 
+        // The force pushing `entity` away from everything it is close to or about to run into.
+        // Safe to call from several threads at once
+        Vector2 GetForce(
+            entt::entity entity,
+            Vector3 position3D,
+            Vector2 velocity,
+            float ksi,
+            float avoidanceT) const
+        {
             float forceScaleFactor = ksi / 2.0f;
             if(ksi < 2.0f)
                 forceScaleFactor = 1.0f;
 
-            Vector2 separationForce = Vector2Zero();
-            Vector2 forces = {
-                .x = acceleration.acceleration.x / time,
-                .y = acceleration.acceleration.z / time,
-            };
+            const Vector2 position = {position3D.x, position3D.z};
+            const AvoidanceForces avoidanceForces = GetAvoidanceForces(
+                GetNeighbours(entity, position3D),
+                position,
+                velocity,
+                AGENT_RADIUS,
+                avoidanceT);
+            return Vector2Add(
+                Vector2Scale(avoidanceForces.avoidance, forceScaleFactor),
+                avoidanceForces.separation);
+        }
 
-            const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
+        // Same as GetForce but only for the closest few, and away from where it is crowded for
+        // everyone else. Costs about the same no matter how crowded it is. Safe to call from
+        // several threads at once
+        Vector2 GetCrowdForce(
+            entt::entity entity,
+            Vector3 position3D,
+            Vector2 velocity,
+            float ksi,
+            float avoidanceT) const
+        {
+            float forceScaleFactor = ksi / 2.0f;
+            if(ksi < 2.0f)
+                forceScaleFactor = 1.0f;
 
-            for(auto [otherEntity, otherTransform, otherHealth] :
-                registry.view<Component::Transform, Component::Health>().each())
+            const Vector2 position = {position3D.x, position3D.z};
+            const AvoidanceForces avoidanceForces = GetAvoidanceForces(
+                GetClosestNeighbours(entity, position3D),
+                position,
+                velocity,
+                AGENT_RADIUS,
+                avoidanceT);
+
+            // Going against the flow is what causes collisions, going with it is fine
+            const CrowdDensity::Sample crowd = crowdDensity.GetSample(position, velocity);
+            float against = 0.0f;
+            if(Vector2Length(velocity) > 0.001f && Vector2Length(crowd.velocity) > 0.001f)
             {
-                if(entity == otherEntity)
-                    continue;
+                against = 0.5f
+                          * (1.0f
+                             - Vector2DotProduct(
+                                 Vector2Normalize(velocity),
+                                 Vector2Normalize(crowd.velocity)));
+            }
+            const Vector2 crowdForce =
+                Vector2Scale(crowd.gradient, -CROWD_PRESSURE * (1.0f + against));
+
+            return Vector2Add(
+                Vector2Add(
+                    Vector2Scale(avoidanceForces.avoidance, forceScaleFactor),
+                    avoidanceForces.separation),
+                crowdForce);
+        }
 
-                float distance = Vector3Distance(transform.position, otherTransform.position);
+        // Whether anything is close enough to `entity` to be avoided. Cheaper than GetForce and
+        // GetVelocity, and safe to call from several threads at once
+        bool HasNeighbours(entt::entity entity, Vector3 position3D) const
+        {
+            bool found = false;
+            spatialHash.ForEachNear(
+                {position3D.x, position3D.z},
+                AVOIDANCE_RANGE,
+                [&](uint32_t otherIndex) {
+                    const Other& other = others[otherIndex];
+                    found = found
+                            || (entity != other.entity
+                                && Vector3Distance(position3D, other.position) <= AVOIDANCE_RANGE);
+                });
+            return found;
+        }
 
-                if(distance > 3.0f)
-                    continue;
+        // The velocity closest to preferredVelocity that doesn't run into anything within
+        // timeHorizon, or into any wall, see GetOrcaVelocity. Safe to call from several threads at
+        // once
+        Vector2 GetVelocity(
+            entt::entity entity,
+            Vector3 position3D,
+            Vector2 velocity,
+            Vector2 preferredVelocity,
+            float maxSpeed,
+            const Navigation& navigation,
+            float timeHorizon,
+            float time) const
+        {
+            const Vector2 position = {position3D.x, position3D.z};
+            // Walls further away than this can't be reached within WALL_TIME_HORIZON
+            const float wallRange = AGENT_RADIUS + maxSpeed * WALL_TIME_HORIZON;
+            return GetOrcaVelocity(
+                GetNeighbours(entity, position3D),
+                GetWallsAround(navigation, position, wallRange),
+                position,
+                velocity,
+                preferredVelocity,
+                maxSpeed,
+                AGENT_RADIUS,
+                timeHorizon,
+                WALL_TIME_HORIZON,
+                time);
+        }
 
-                Vector2 otherVelocity = Vector2Zero();
-                if(Component::Velocity* oVel = registry.try_get<Component::Velocity>(otherEntity);
-                   oVel)
-                {
-                    otherVelocity = {.x = oVel->ToVector3().x, .y = oVel->ToVector3().z};
-                };
-                Vector2 position = {transform.position.x, transform.position.z};
-                Vector2 otherPosition = {otherTransform.position.x, otherTransform.position.z};
+      private:
+        // Anything further away than this is ignored
+        static constexpr float AVOIDANCE_RANGE = 3.0f;
+        static constexpr float AGENT_RADIUS = 0.30f;
+        // Walls can't be walked through at all with ORCA, so there is no need to look as far ahead
+        // as AvoidObstacles does. Looking further makes agents keep away from walls and crowd into
+        // each other at every corner instead
+        static constexpr float WALL_TIME_HORIZON = 0.5f;
+        // GetCrowdForce only looks at this many neighbours, and only at the ones this close. No
+        // more than a handful of agents fit that close, so the cost doesn't grow with the crowd
+        static constexpr size_t CLOSEST_NEIGHBOURS = 4;
+        static constexpr float CLOSE_RANGE = 1.0f;
+        // How hard agents are pushed away from where it is crowded
+        static constexpr float CROWD_PRESSURE = 2.0f;
 
-                if(distance < 1.0f)
-                {
-                    separationForce = Vector2Add(
-                        separationForce,
-                        Vector2Scale(Vector2DirectionTo(otherPosition, position), 1.0f / distance));
-                }
+        struct Other
+        {
+            entt::entity entity;
+            Vector3 position;
+            Vector2 velocity;
+        };
+        std::vector<Other> others;
+        std::vector<Vector2> otherPositions;
+        SpatialHash spatialHash = SpatialHash(AVOIDANCE_RANGE);
+        SpatialHash closeSpatialHash = SpatialHash(CLOSE_RANGE);
+        std::vector<Vector2> crowdPositions;
+        std::vector<Vector2> crowdVelocities;
+        CrowdDensity crowdDensity;
 
-                std::optional<float> timeToCollision =
-                    TimeToCollisionSphere(position, otherPosition, velocity, otherVelocity, radius);
+        // Everything within AVOIDANCE_RANGE of the entity. Only valid until the next call on the
+        // same thread
+        const NeighbourBatch& GetNeighbours(entt::entity entity, Vector3 position3D) const
+        {
+            // One per thread, kept around to not allocate for every agent
+            static thread_local NeighbourBatch neighbours;
 
-                if(!timeToCollision.has_value())
-                    continue;
+            neighbours.Clear();
+            spatialHash.ForEachNear(
+                {position3D.x, position3D.z},
+                AVOIDANCE_RANGE,
+                [&](uint32_t otherIndex) {
+                    const Other& other = others[otherIndex];
+                    if(entity == other.entity)
+                        return;
 
-                float t = timeToCollision.value();
+                    float distance = Vector3Distance(position3D, other.position);
 
-                if(t == 0.0f)
-                {
-                    Vector2 avoidanceForce = Vector2DirectionTo(otherPosition, position);
-                    float magnitude = Vector2Length(velocity);
+                    if(distance > AVOIDANCE_RANGE)
+                        return;
 
-                    if(magnitude > 10.0f)
-                        magnitude = 10.0f;
+                    neighbours.Add({other.position.x, other.position.z}, other.velocity, distance);
+                });
+            return neighbours;
+        }
 
-                    forces.x += avoidanceForce.x * magnitude * forceScaleFactor;
-                    forces.y += avoidanceForce.y * magnitude * forceScaleFactor;
-                }
-                else
-                {
-                    Vector2 avoidanceForce = Vector2Normalize(Vector2Subtract(
-                        Vector2Add(position, Vector2Scale(velocity, t)),
-                        Vector2Add(otherPosition, Vector2Scale(otherVelocity, t))));
+        // The CLOSEST_NEIGHBOURS closest within CLOSE_RANGE of the entity. Only valid until the
+        // next call on the same thread
+        const NeighbourBatch& GetClosestNeighbours(entt::entity entity, Vector3 position3D) const
+        {
+            // One per thread, kept around to not allocate for every agent
+            static thread_local NeighbourBatch neighbours;
+            static thread_local std::vector<std::pair<float, uint32_t>> closest;
 
-                    float magnitude = 0.0f;
-                    if(t >= 0.0f && t < avoidanceT)
-                        magnitude = (avoidanceT - t) / (t + 0.001f);
+            closest.clear();
+            closeSpatialHash.ForEachNear(
+                {position3D.x, position3D.z},
+                CLOSE_RANGE,
+                [&](uint32_t otherIndex) {
+                    const Other& other = others[otherIndex];
+                    if(entity == other.entity)
+                        return;
 
-                    if(magnitude > 20.0f)
-                        magnitude = 20.0f;
+                    float distance = Vector3Distance(position3D, other.position);
 
-                    forces.x += avoidanceForce.x * magnitude * forceScaleFactor;
-                    forces.y += avoidanceForce.y * magnitude * forceScaleFactor;
-                }
+                    if(distance > CLOSE_RANGE)
+                        return;
+
+                    closest.push_back({distance, otherIndex});
+                });
+
+            const size_t count = std::min(closest.size(), CLOSEST_NEIGHBOURS);
+            std::partial_sort(closest.begin(), closest.begin() + count, closest.end());
+
+            neighbours.Clear();
+            for(size_t i = 0; i < count; ++i)
+            {
+                const Other& other = others[closest[i].second];
+                neighbours.Add(
+                    {other.position.x, other.position.z},
+                    other.velocity,
+                    closest[i].first);
             }
+            return neighbours;
+        }
+    };
+
+    // Only AvoidanceModel::FORCES and AvoidanceModel::DENSITY, see AvoidEntitiesOrca. The agents
+    // are split between the threads of threadPool if there is one
+    void AvoidEntities(
+        entt::registry& registry,
+        const Navigation& navigation,
+        float ksi,
+        float avoidanceT,
+        float time,
+        AvoidanceModel avoidanceModel,
+        ThreadPool* threadPool)
+    {
+        static EntityAvoidance avoidance;
+        static std::vector<entt::entity> agents;
+
+        avoidance.Gather(registry);
+        if(avoidanceModel == AvoidanceModel::DENSITY)
+            avoidance.GatherCrowd(registry, navigation);
+
+        auto view = registry.view<
+            Component::Transform,
+            Component::MoveTowards,
+            Component::Velocity,
+            Component::Acceleration>();
+        agents.assign(view.begin(), view.end());
+
+        ForEachAgent(threadPool, agents, [&](size_t agentIndex) {
+            const entt::entity entity = agents[agentIndex];
+            auto [transform, velocityComponent, acceleration] =
+                view.get<Component::Transform, Component::Velocity, Component::Acceleration>(
+                    entity);
 
-            forces.x += separationForce.x;
-            forces.y += separationForce.y;
+            Vector2 forces = {
+                .x = acceleration.acceleration.x / time,
+                .y = acceleration.acceleration.z / time,
+            };
+
+            const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
+            forces = Vector2Add(
+                forces,
+                avoidanceModel == AvoidanceModel::DENSITY
+                    ? avoidance.GetCrowdForce(entity, transform.position, velocity, ksi, avoidanceT)
+                    : avoidance.GetForce(entity, transform.position, velocity, ksi, avoidanceT));
 
             acceleration.acceleration.x += forces.x * time;
             acceleration.acceleration.z += forces.y * time;
-        }
+        });
     }
-}
\ No newline at end of file
+
+    // The ORCA version of AvoidEntities and AvoidObstacles. The acceleration from Navigate is what
+    // the agent would like to do, and the velocity is set to whatever is closest to that without
+    // running into anyone or any wall. Uses up the acceleration, so it has to run after Navigate.
+    // The agents are split between the threads of threadPool if there is one
+    void AvoidEntitiesOrca(
+        entt::registry& registry,
+        const Navigation& navigation,
+        float avoidanceT,
+        float time,
+        ThreadPool* threadPool)
+    {
+        static EntityAvoidance avoidance;
+        static std::vector<entt::entity> agents;
+
+        avoidance.Gather(registry);
+
+        auto view = registry.view<
+            Component::Transform,
+            Component::MoveTowards,
+            Component::Velocity,
+            Component::Acceleration>();
+        agents.assign(view.begin(), view.end());
+
+        ForEachAgent(threadPool, agents, [&](size_t agentIndex) {
+            const entt::entity entity = agents[agentIndex];
+            auto [transform, moveTowards, velocityComponent, acceleration] = view.get<
+                Component::Transform,
+                Component::MoveTowards,
+                Component::Velocity,
+                Component::Acceleration>(entity);
+
+            const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
+            const Vector2 preferredVelocity =
+                Vector2Add(velocity, Vector3Flatten(acceleration.acceleration));
+            const Vector2 newVelocity = avoidance.GetVelocity(
+                entity,
+                transform.position,
+                velocity,
+                preferredVelocity,
+                moveTowards.speed,
+                navigation,
+                avoidanceT,
+                time);
+
+            velocityComponent.x = newVelocity.x;
+            velocityComponent.y += acceleration.acceleration.y;
+            velocityComponent.z = newVelocity.y;
+            acceleration.acceleration = {0.0f, 0.0f, 0.0f};
+        });
+    }
+}
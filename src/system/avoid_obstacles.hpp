@@ -1,10 +1,15 @@
+#pragma once
+
 #include <entt/entt.hpp>
 #include <external/raylib.hpp>
+#include <algorithm>
+#include <span>
 #include <string>
 #include <vector>
 
 #include <navigation.hpp>
 #include <profiling.hpp>
+#include <thread_pool.hpp>
 
 #include <component/acceleration.hpp>
 #include <component/health.hpp>
@@ -12,6 +17,8 @@
 #include <component/transform.hpp>
 #include <component/velocity.hpp>
 
+#include <system/for_each_agent.hpp>
+
 // https://ericleong.me/research/circle-line/
 std::optional<Vector2> lineLineIntersection(
     Vector2 start0,
@@ -195,26 +202,135 @@ std::optional<float> TimeToCollisionCircleLine(
     return std::nullopt;
 }
 
+// Cheap test for whether a circle moving in a straight line from `from` to `to` could touch the
+// wall at all, to skip TimeToCollisionCircleLine for most walls. Only rules out walls whose line
+// the circle stays clear of the whole way, without a single square root
+bool MightSweepHitWall(const Navigation::Wall& wall, Vector2 from, Vector2 to, float radius)
+{
+    const Vector2 along = Vector2Subtract(wall.end, wall.start);
+    // Distances to the line through the wall, both scaled by the length of the wall
+    const float fromDistance =
+        along.x * (from.y - wall.start.y) - along.y * (from.x - wall.start.x);
+    const float toDistance = along.x * (to.y - wall.start.y) - along.y * (to.x - wall.start.x);
+    const float scaledRadiusSquared = radius * radius * Vector2Dot(along, along);
+
+    // The distance changes linearly along the way, so if both ends are clear on the same side
+    // everything in between is as well
+    const bool sameSide = (fromDistance > 0.0f) == (toDistance > 0.0f);
+    return !sameSide || fromDistance * fromDistance <= scaledRadiusSquared
+           || toDistance * toDistance <= scaledRadiusSquared;
+}
+
 namespace System
 {
+    // The walls with any part within `range` of position, for GetOrcaVelocity. Only valid until
+    // the next call on the same thread
+    std::span<const Navigation::Wall> GetWallsAround(
+        const Navigation& navigation,
+        Vector2 position,
+        float range)
+    {
+        // Reused between entities to avoid allocating, one per thread
+        static thread_local std::vector<uint32_t> wallSegments;
+        static thread_local std::vector<Navigation::Wall> walls;
+
+        navigation.GetWallSegments(
+            Vector2SubtractValue(position, range),
+            Vector2AddValue(position, range),
+            wallSegments);
+        walls.clear();
+        for(uint32_t segment : wallSegments)
+            walls.push_back(navigation.GetWallSegment(segment));
+        return walls;
+    }
+
+    // Adds what pushes an agent away from the walls it is about to run into to `forces`, which is
+    // what the wall normals are scaled by. Safe to call from several threads at once
+    Vector2 AddObstacleAvoidance(
+        const Navigation& navigation,
+        Vector2 position,
+        Vector2 velocity,
+        Vector2 forces,
+        float obstacleT)
+    {
+        // Reused between entities to avoid allocating, one per thread
+        static thread_local std::vector<uint32_t> wallSegments;
+
+        const float radius = 0.30f;
+
+        // Nothing is run into without moving
+        if(velocity.x == 0.0f && velocity.y == 0.0f)
+            return forces;
+
+        // TimeToCollisionCircleLine looks at least one second ahead, so only the walls along the
+        // way there, or to obstacleT if that is further, can be hit
+        const Vector2 sweepEnd =
+            Vector2Add(position, Vector2Scale(velocity, std::max(obstacleT, 1.0f)));
+        navigation.GetWallSegments(
+            {
+                .x = std::min(position.x, sweepEnd.x) - radius,
+                .y = std::min(position.y, sweepEnd.y) - radius,
+            },
+            {
+                .x = std::max(position.x, sweepEnd.x) + radius,
+                .y = std::max(position.y, sweepEnd.y) + radius,
+            },
+            wallSegments);
+        for(uint32_t segment : wallSegments)
+        {
+            const Navigation::Wall& wall = navigation.GetWallSegment(segment);
+            if(!MightSweepHitWall(wall, position, sweepEnd, radius))
+                continue;
+
+            std::optional<float> timeToCollisionOpt =
+                TimeToCollisionCircleLine(position, velocity, radius, wall.start, wall.end);
+            if(!timeToCollisionOpt || *timeToCollisionOpt > obstacleT)
+                continue;
+
+            float timeToCollision = timeToCollisionOpt.value();
+
+            Vector2 avoidanceForce = Vector2Scale(
+                wall.normal,
+                Vector2Dot(forces, wall.normal) / Vector2Dot(wall.normal, wall.normal));
+
+            if(Vector2Dot(avoidanceForce, wall.normal) < 0.0f)
+                avoidanceForce = Vector2Negate(avoidanceForce);
+
+            float magnitude = 0.0f;
+            if(timeToCollision >= 0.0f && timeToCollision < obstacleT)
+                magnitude = (obstacleT - timeToCollision) / (timeToCollision + 0.001f);
+
+            if(magnitude > 40.0f)
+                magnitude = 40.0f;
+
+            forces.x += avoidanceForce.x * magnitude;
+            forces.y += avoidanceForce.y * magnitude;
+        }
+
+        return forces;
+    }
+
+    // The agents are split between the threads of threadPool if there is one
     void AvoidObstacles(
         entt::registry& registry,
         Navigation& navigation,
         float obstacleT,
-        float time)
+        float time,
+        ThreadPool* threadPool)
     {
-        for(auto [entity, transform, moveTowards, velocityComponent, acceleration] :
-            registry
-                .view<
-                    Component::Transform,
-                    Component::MoveTowards,
-                    Component::Velocity,
-                    Component::Acceleration>()
-                .each())
-        {
-            PROFILE_SCOPE((ENTT_ID_TYPE)entity);
+        static std::vector<entt::entity> agents;
+
+        auto view = registry.view<
+            Component::Transform,
+            Component::MoveTowards,
+            Component::Velocity,
+            Component::Acceleration>();
+        agents.assign(view.begin(), view.end());
 
-            const float radius = 0.30f;
+        ForEachAgent(threadPool, agents, [&](size_t agentIndex) {
+            auto [transform, velocityComponent, acceleration] =
+                view.get<Component::Transform, Component::Velocity, Component::Acceleration>(
+                    agents[agentIndex]);
 
             Vector2 forces = {
                 .x = acceleration.acceleration.x / time,
@@ -224,52 +340,10 @@ namespace System
             const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
 
             Vector2 position = {.x = transform.position.x, .y = transform.position.z};
-            float currentSpeed = Vector2Length(velocity);
-            navigation.ForArea(
-                {
-                    .x = transform.position.x - currentSpeed * obstacleT,
-                    .y = transform.position.z - currentSpeed * obstacleT,
-                },
-                {
-                    .x = transform.position.x + currentSpeed * obstacleT,
-                    .y = transform.position.z + currentSpeed * obstacleT,
-                },
-                [&](const Navigation::Tile& tile, uint32_t x, uint32_t y) {
-                    tile.ForEachWall([&](Navigation::Tile::Side side) {
-                        Navigation::Wall wall = navigation.GetWall(x, y, side);
-
-                        std::optional<float> timeToCollisionOpt = TimeToCollisionCircleLine(
-                            position,
-                            velocity,
-                            radius,
-                            wall.start,
-                            wall.end);
-                        if(!timeToCollisionOpt || *timeToCollisionOpt > obstacleT)
-                            return;
-
-                        float timeToCollision = timeToCollisionOpt.value();
-
-                        Vector2 avoidanceForce = Vector2Scale(
-                            wall.normal,
-                            Vector2Dot(forces, wall.normal) / Vector2Dot(wall.normal, wall.normal));
-
-                        if(Vector2Dot(avoidanceForce, wall.normal) < 0.0f)
-                            avoidanceForce = Vector2Negate(avoidanceForce);
-
-                        float magnitude = 0.0f;
-                        if(timeToCollision >= 0.0f && timeToCollision < obstacleT)
-                            magnitude = (obstacleT - timeToCollision) / (timeToCollision + 0.001f);
-
-                        if(magnitude > 40.0f)
-                            magnitude = 40.0f;
-
-                        forces.x += avoidanceForce.x * magnitude;
-                        forces.y += avoidanceForce.y * magnitude;
-                    });
-                });
+            forces = AddObstacleAvoidance(navigation, position, velocity, forces, obstacleT);
 
             acceleration.acceleration.x += forces.x * time;
             acceleration.acceleration.z += forces.y * time;
-        }
+        });
     }
 }
\ No newline at end of file
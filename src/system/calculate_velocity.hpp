@@ -1,3 +1,5 @@
+#pragma once
+
 #include <entt/entt.hpp>
 #include <external/raylib.hpp>
 #include <string>
@@ -15,25 +17,35 @@
 
 namespace System
 {
-    // Apply an entity's acceleration to their velocity
-    void CalculateVelocity(entt::registry& registry, float time)
+    // What CalculateVelocity adds to the velocity of an entity with this acceleration
+    Vector3 CapAcceleration(Vector3 acceleration, float time)
+    {
+        float length = Vector3Length(acceleration);
+        // Cap the acceleration if it is too big, this is a limitation of
+        // force-based collision avoidance
+        if(length > 20.0f * time)
+            acceleration = Vector3Scale(Vector3Normalize(acceleration), 20.0f * time);
+
+        // I ran into some NaN issues, so just a safeguard
+        assert(!std::isnan(acceleration.x));
+        assert(!std::isnan(acceleration.y));
+        assert(!std::isnan(acceleration.z));
+
+        return acceleration;
+    }
+
+    // Apply an entity's acceleration to their velocity. Entities that skip(entity) is true for are
+    // left alone
+    template<typename Skip>
+    void CalculateVelocity(entt::registry& registry, float time, const Skip& skip)
     {
         for(auto [entity, velocity, acceleration] :
             registry.view<Component::Velocity, Component::Acceleration>().each())
         {
-            float length = Vector3Length(acceleration.acceleration);
-            // Cap the acceleration if it is too big, this is a limitation of
-            // force-based collision avoidance
-            if(length > 20.0f * time)
-            {
-                acceleration.acceleration =
-                    Vector3Scale(Vector3Normalize(acceleration.acceleration), 20.0f * time);
-            }
-
-            // I ran into some NaN issues, so just a safeguard
-            assert(!std::isnan(acceleration.acceleration.x));
-            assert(!std::isnan(acceleration.acceleration.y));
-            assert(!std::isnan(acceleration.acceleration.z));
+            if(skip(entity))
+                continue;
+
+            acceleration.acceleration = CapAcceleration(acceleration.acceleration, time);
 
             velocity.x += acceleration.acceleration.x;
             velocity.y += acceleration.acceleration.y;
@@ -42,4 +54,10 @@ namespace System
             acceleration.acceleration = {0.0f, 0.0f, 0.0f};
         }
     }
+
+    // Apply an entity's acceleration to their velocity
+    void CalculateVelocity(entt::registry& registry, float time)
+    {
+        CalculateVelocity(registry, time, [](entt::entity) { return false; });
+    }
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <entt/entt.hpp>
+
+#include <algorithm>
+#include <span>
+
+#include <profiling.hpp>
+#include <thread_pool.hpp>
+
+namespace System
+{
+    // Agents are handed to the threads this many at a time, handing them out one by one costs
+    // more than most systems spend on an agent
+    constexpr size_t AGENT_BATCH_SIZE = 64;
+
+    // Calls func(i) for every i in [0, agents.size()). Without a thread pool this is a plain loop
+    // with every agent in its own profiling scope. With one the agents are split between its
+    // threads, so func may only write to the components of agents[i] and must not profile since
+    // the profiler isn't thread safe
+    template<typename Func>
+    void ForEachAgent(
+        ThreadPool* threadPool,
+        std::span<const entt::entity> agents,
+        const Func& func)
+    {
+        if(!threadPool)
+        {
+            for(size_t i = 0; i < agents.size(); ++i)
+            {
+                PROFILE_SCOPE((ENTT_ID_TYPE)agents[i]);
+                func(i);
+            }
+            return;
+        }
+
+        const size_t batchCount = (agents.size() + AGENT_BATCH_SIZE - 1) / AGENT_BATCH_SIZE;
+        threadPool->ParallelFor(batchCount, [&](size_t batch) {
+            const size_t end = std::min(agents.size(), (batch + 1) * AGENT_BATCH_SIZE);
+            for(size_t i = batch * AGENT_BATCH_SIZE; i < end; ++i)
+                func(i);
+        });
+    }
+}
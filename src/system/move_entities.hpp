@@ -1,3 +1,5 @@
+#pragma once
+
 #include <entt/entt.hpp>
 
 #include <component/transform.hpp>
@@ -5,15 +7,26 @@
 
 namespace System
 {
-    // For all entities with Transform + Velocity components, update their position
-    void MoveEntities(entt::registry& registry, float time)
+    // For all entities with Transform + Velocity components, update their position. Entities that
+    // skip(entity) is true for are left alone
+    template<typename Skip>
+    void MoveEntities(entt::registry& registry, float time, const Skip& skip)
     {
         for(auto [entity, transform, velocity] :
             registry.view<Component::Transform, Component::Velocity>().each())
         {
+            if(skip(entity))
+                continue;
+
             transform.position.x += velocity.x * time;
             transform.position.y += velocity.y * time;
             transform.position.z += velocity.z * time;
         }
     }
+
+    // For all entities with Transform + Velocity components, update their position
+    void MoveEntities(entt::registry& registry, float time)
+    {
+        MoveEntities(registry, time, [](entt::entity) { return false; });
+    }
 }
\ No newline at end of file
@@ -1,11 +1,17 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
 #include <entt/entt.hpp>
 #include <external/raylib.hpp>
+#include <span>
 #include <string>
 #include <vector>
 
 #include <navigation.hpp>
 #include <profiling.hpp>
 #include <random>
+#include <thread_pool.hpp>
 
 #include <component/acceleration.hpp>
 #include <component/health.hpp>
@@ -13,6 +19,8 @@
 #include <component/transform.hpp>
 #include <component/velocity.hpp>
 
+#include <system/for_each_agent.hpp>
+
 static std::random_device rd;
 static std::mt19937 mt(rd());
 // This range is awctually [-1, 1), but that's fine
@@ -20,45 +28,187 @@ static std::uniform_real_distribution<float> randomNumber(-1.0, 1.0f);
 
 namespace System
 {
-    // For all enemies that are moving towards a goal, navigate in the environment and update their
-    // acceleration
-    void Navigate(entt::registry& registry, Navigation& navigation, float ksi, float time)
+    // Kills agents that have reached their goal and resolves the field handle of the rest. Returns
+    // whether the agent should still be steered towards its goal
+    bool UpdateGoal(
+        entt::registry& registry,
+        Navigation& navigation,
+        entt::entity entity,
+        const Component::Transform& transform,
+        Component::MoveTowards& moveTowards)
     {
-        for(auto [entity, transform, moveTowards, velocityComponent, acceleration] :
-            registry
-                .view<
-                    Component::Transform,
-                    Component::MoveTowards,
-                    Component::Velocity,
-                    Component::Acceleration>()
-                .each())
+        Vector2 tilePos = navigation.GetTileSpace(Vector3Flatten(transform.position));
+        if(navigation.IsGoal(tilePos.x, tilePos.y))
         {
-            PROFILE_SCOPE((ENTT_ID_TYPE)entity);
+            if(auto health = registry.try_get<Component::Health>(entity); health)
+                health->currentHealth = 0.0f;
+            return false;
+        }
+
+        // The handle goes stale if navigation is rebuilt or the id is changed in the editor
+        const auto fieldId = (int32_t)moveTowards.vectorFieldId;
+        if(!navigation.IsHandleValid(moveTowards.fieldHandle, fieldId))
+            moveTowards.fieldHandle = navigation.ResolveField(fieldId);
+        return true;
+    }
+
+    // The force steering an agent towards its goal. fieldForce is what the field gives for the
+    // position of the agent and randomForce is what keeps agents from lining up perfectly
+    Vector2 GetNavigationForce(
+        Vector2 fieldForce,
+        float speed,
+        Vector2 velocity,
+        Vector2 randomForce,
+        float ksi)
+    {
+        Vector3 movementDirection = {fieldForce.x, 0.0f, fieldForce.y};
+
+        Vector3 goalVelocity = Vector3Scale(movementDirection, speed);
+
+        Vector2 forces = Vector2Scale(Vector2Subtract(Vector3Flatten(goalVelocity), velocity), ksi);
+
+        return Vector2Add(forces, Vector2Scale(randomForce, 0.5f));
+    }
+
+    // Two random numbers in [-1, 1) for GetNavigationForce. Not thread safe
+    Vector2 GetRandomForce()
+    {
+        return {randomNumber(mt), randomNumber(mt)};
+    }
+
+    // Looks up forces[i], the force of field fields[i] at positions[i], for many agents at once.
+    // The agents are sorted by field so that each field is looked up in batches, which are split
+    // between the threads of threadPool if there is one. Not thread safe
+    void GetFieldForces(
+        const Navigation& navigation,
+        std::span<const Navigation::FieldHandle> fields,
+        std::span<const Vector2> positions,
+        std::span<Vector2> forces,
+        bool interpolateForces,
+        ThreadPool* threadPool)
+    {
+        assert(fields.size() == positions.size() && fields.size() == forces.size());
+
+        // Field index and index into fields. Kept around between frames to not allocate every
+        // frame
+        static std::vector<std::pair<uint32_t, uint32_t>> order;
+        static std::vector<Vector2> sortedPositions;
+        static std::vector<Vector2> sortedForces;
+        // [begin, end) into order, every batch is in one field
+        static std::vector<std::pair<size_t, size_t>> batches;
+
+        order.resize(fields.size());
+        for(size_t i = 0; i < fields.size(); ++i)
+            order[i] = {fields[i].index, (uint32_t)i};
+        std::sort(order.begin(), order.end());
+
+        sortedPositions.resize(order.size());
+        sortedForces.resize(order.size());
+        for(size_t i = 0; i < order.size(); ++i)
+            sortedPositions[i] = positions[order[i].second];
 
-            Vector2 tilePos = navigation.GetTileSpace(Vector3Flatten(transform.position));
-            if(navigation.IsGoal(tilePos.x, tilePos.y))
-            {
-                if(auto health = registry.try_get<Component::Health>(entity); health)
-                    health->currentHealth = 0.0f;
+        // Fields are split into batches of AGENT_BATCH_SIZE so that one big field can be looked up
+        // by several threads. The batches all start at an even offset from the start of the field,
+        // so GetForces pairs up the same positions as it would with the whole field at once
+        batches.clear();
+        for(size_t begin = 0; begin < order.size();)
+        {
+            size_t end = begin + 1;
+            while(end < order.size() && order[end].first == order[begin].first)
+                ++end;
+
+            for(size_t batchBegin = begin; batchBegin < end; batchBegin += AGENT_BATCH_SIZE)
+                batches.push_back({batchBegin, std::min(batchBegin + AGENT_BATCH_SIZE, end)});
+            begin = end;
+        }
+
+        auto getForces = [&](size_t batch) {
+            const auto [begin, end] = batches[batch];
+            navigation.GetForces(
+                fields[order[begin].second],
+                std::span(sortedPositions).subspan(begin, end - begin),
+                std::span(sortedForces).subspan(begin, end - begin),
+                interpolateForces);
+        };
+        if(threadPool)
+        {
+            threadPool->ParallelFor(batches.size(), getForces);
+        }
+        else
+        {
+            for(size_t batch = 0; batch < batches.size(); ++batch)
+                getForces(batch);
+        }
+
+        for(size_t i = 0; i < order.size(); ++i)
+            forces[order[i].second] = sortedForces[i];
+    }
+
+    // For all enemies that are moving towards a goal, navigate in the environment and update their
+    // acceleration. The agents are split between the threads of threadPool if there is one
+    void Navigate(
+        entt::registry& registry,
+        Navigation& navigation,
+        float ksi,
+        float time,
+        bool interpolateForces,
+        ThreadPool* threadPool)
+    {
+        auto view = registry.view<
+            Component::Transform,
+            Component::MoveTowards,
+            Component::Velocity,
+            Component::Acceleration>();
+
+        // Kept around between frames to not allocate every frame
+        static std::vector<entt::entity> agents;
+        static std::vector<Navigation::FieldHandle> agentFields;
+        static std::vector<Vector2> agentPositions;
+        static std::vector<Vector2> agentForces;
+        static std::vector<Vector2> randomForces;
+        agents.clear();
+        agentFields.clear();
+        agentPositions.clear();
+        randomForces.clear();
+
+        for(auto [entity, transform, moveTowards, velocityComponent, acceleration] : view.each())
+        {
+            if(!UpdateGoal(registry, navigation, entity, transform, moveTowards))
                 continue;
-            }
 
-            Vector2 force =
-                navigation.GetForce(moveTowards.vectorFieldId, Vector3Flatten(transform.position));
+            agents.push_back(entity);
+            agentFields.push_back(moveTowards.fieldHandle);
+            agentPositions.push_back(Vector3Flatten(transform.position));
+            // Drawn up front and in order so the result doesn't depend on how the agents are split
+            // between threads
+            randomForces.push_back(GetRandomForce());
+        }
 
-            Vector3 movementDirection = {force.x, 0.0f, force.y};
+        agentForces.resize(agents.size());
+        GetFieldForces(
+            navigation,
+            agentFields,
+            agentPositions,
+            agentForces,
+            interpolateForces,
+            threadPool);
 
-            float speed = moveTowards.speed;
-            Vector3 goalVelocity = Vector3Scale(movementDirection, speed);
+        ForEachAgent(threadPool, agents, [&](size_t i) {
+            auto [moveTowards, velocityComponent, acceleration] = view.get<
+                Component::MoveTowards,
+                Component::Velocity,
+                Component::Acceleration>(agents[i]);
 
             const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
-            Vector2 forces =
-                Vector2Scale(Vector2Subtract(Vector3Flatten(goalVelocity), velocity), ksi);
-
-            forces = Vector2Add(forces, Vector2Scale({randomNumber(mt), randomNumber(mt)}, 0.5f));
+            const Vector2 forces = GetNavigationForce(
+                agentForces[i],
+                moveTowards.speed,
+                velocity,
+                randomForces[i],
+                ksi);
 
             acceleration.acceleration.x += forces.x * time;
             acceleration.acceleration.z += forces.y * time;
-        }
+        });
     }
 }
\ No newline at end of file
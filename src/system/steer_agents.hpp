@@ -0,0 +1,212 @@
+#pragma once
+
+#include <entt/entt.hpp>
+#include <external/raylib.hpp>
+#include <vector>
+
+#include <navigation.hpp>
+#include <thread_pool.hpp>
+
+#include <component/acceleration.hpp>
+#include <component/move_towards.hpp>
+#include <component/transform.hpp>
+#include <component/velocity.hpp>
+
+#include <system/avoid_entities.hpp>
+#include <system/avoid_obstacles.hpp>
+#include <system/calculate_velocity.hpp>
+#include <system/for_each_agent.hpp>
+#include <system/navigate.hpp>
+#include <system/steering_lod.hpp>
+
+namespace System
+{
+    // The agents that SteerAgents steers and moves, everything else still needs CalculateVelocity
+    // and MoveEntities
+    auto GetSteeredAgents(entt::registry& registry)
+    {
+        // Owning the components packs them in the same order, so the agents are walked through
+        // linearly. Transform can't be owned since DrawRenderable's group already owns it
+        return registry.group<
+            Component::MoveTowards,
+            Component::Velocity,
+            Component::Acceleration>(entt::get<Component::Transform>);
+    }
+
+    // Navigate, AvoidEntities, AvoidObstacles, CalculateVelocity and MoveEntities in one pass over
+    // the agents. Every agent is loaded once, all of its forces are added up before they are turned
+    // into an acceleration, and it is moved right away. CalculateVelocity and MoveEntities still
+    // have to run for everything that isn't an agent, see World::Update.
+    //
+    // Agents that lod says aren't interesting only steer every few ticks, but they still move every
+    // tick. Without lod every agent steers every tick. The agents are split between the threads of
+    // threadPool if there is one
+    void SteerAgents(
+        entt::registry& registry,
+        Navigation& navigation,
+        float ksi,
+        float avoidanceT,
+        float obstacleT,
+        float time,
+        bool interpolateForces,
+        AvoidanceModel avoidanceModel,
+        SteeringLod* lod,
+        ThreadPool* threadPool)
+    {
+        auto group = GetSteeredAgents(registry);
+
+        static EntityAvoidance avoidance;
+        static std::vector<entt::entity> agents;
+        // Whether the agent is still on its way to the goal, not a vector<bool> since it is read
+        // from several threads
+        static std::vector<uint8_t> navigating;
+        static std::vector<Vector2> randomForces;
+        // Looked up for every agent that might steer before any of them moves, indexed like agents
+        static std::vector<Vector2> fieldForces;
+        static std::vector<uint32_t> lookups;
+        static std::vector<Navigation::FieldHandle> lookupFields;
+        static std::vector<Vector2> lookupPositions;
+        static std::vector<Vector2> lookupForces;
+
+        // Everything that other agents read has to be gathered before any agent moves
+        avoidance.Gather(registry);
+        if(avoidanceModel == AvoidanceModel::DENSITY)
+            avoidance.GatherCrowd(registry, navigation);
+
+        agents.assign(group.begin(), group.end());
+        if(lod)
+            lod->Track(agents);
+        navigating.resize(agents.size());
+        randomForces.resize(agents.size());
+        fieldForces.resize(agents.size());
+        lookups.clear();
+        lookupFields.clear();
+        lookupPositions.clear();
+        for(size_t i = 0; i < agents.size(); ++i)
+        {
+            auto [moveTowards, transform] =
+                group.get<Component::MoveTowards, Component::Transform>(agents[i]);
+            navigating[i] = UpdateGoal(registry, navigation, agents[i], transform, moveTowards);
+            if(!navigating[i])
+                continue;
+
+            randomForces[i] = GetRandomForce();
+            if(!lod || lod->MightSteer(agents[i], transform.position))
+            {
+                lookups.push_back((uint32_t)i);
+                lookupFields.push_back(moveTowards.fieldHandle);
+                lookupPositions.push_back(Vector3Flatten(transform.position));
+            }
+        }
+
+        lookupForces.resize(lookups.size());
+        GetFieldForces(
+            navigation,
+            lookupFields,
+            lookupPositions,
+            lookupForces,
+            interpolateForces,
+            threadPool);
+        for(size_t i = 0; i < lookups.size(); ++i)
+            fieldForces[lookups[i]] = lookupForces[i];
+
+        ForEachAgent(threadPool, agents, [&](size_t i) {
+            const entt::entity entity = agents[i];
+            auto [moveTowards, velocityComponent, acceleration, transform] = group.get<
+                Component::MoveTowards,
+                Component::Velocity,
+                Component::Acceleration,
+                Component::Transform>(entity);
+
+            uint32_t steeringTicks = 1;
+            if(lod)
+            {
+                // Looking for neighbours costs more, so it is only done if it matters
+                const bool interesting = lod->IsInteresting(transform.position)
+                                         && avoidance.HasNeighbours(entity, transform.position);
+                steeringTicks = lod->GetSteeringTicks(entity, interesting);
+            }
+            if(steeringTicks == 0)
+            {
+                // The acceleration is kept until the agent steers again
+                transform.position = Vector3Add(
+                    transform.position,
+                    Vector3Scale(velocityComponent.ToVector3(), time));
+                return;
+            }
+            // Steering for several ticks at once is the same as steering for a longer time
+            const float steeringTime = time * (float)steeringTicks;
+
+            const Vector2 position = Vector3Flatten(transform.position);
+            const Vector2 velocity = {.x = velocityComponent.x, .y = velocityComponent.z};
+
+            Vector2 forces =
+                Vector2Scale(Vector3Flatten(acceleration.acceleration), 1.0f / steeringTime);
+            if(navigating[i])
+            {
+                forces = Vector2Add(
+                    forces,
+                    GetNavigationForce(
+                        fieldForces[i],
+                        moveTowards.speed,
+                        velocity,
+                        randomForces[i],
+                        ksi));
+            }
+
+            if(avoidanceModel == AvoidanceModel::ORCA)
+            {
+                // Walls are part of the linear program, so there is no AddObstacleAvoidance
+                const Vector2 preferredVelocity =
+                    Vector2Add(velocity, Vector2Scale(forces, steeringTime));
+                const Vector2 newVelocity = avoidance.GetVelocity(
+                    entity,
+                    transform.position,
+                    velocity,
+                    preferredVelocity,
+                    moveTowards.speed,
+                    navigation,
+                    avoidanceT,
+                    steeringTime);
+                velocityComponent.x = newVelocity.x;
+                velocityComponent.y += acceleration.acceleration.y;
+                velocityComponent.z = newVelocity.y;
+            }
+            else
+            {
+                // AvoidEntities and AvoidObstacles both add the acceleration they start out with
+                // on top of their own forces, which is kept so both ways of steering behave the
+                // same
+                const Vector2 avoidanceForce =
+                    avoidanceModel == AvoidanceModel::DENSITY
+                        ? avoidance.GetCrowdForce(
+                              entity,
+                              transform.position,
+                              velocity,
+                              ksi,
+                              avoidanceT)
+                        : avoidance.GetForce(entity, transform.position, velocity, ksi, avoidanceT);
+                forces = Vector2Add(Vector2Scale(forces, 2.0f), avoidanceForce);
+                forces = Vector2Add(
+                    forces,
+                    AddObstacleAvoidance(navigation, position, velocity, forces, obstacleT));
+
+                const Vector3 cappedAcceleration = CapAcceleration(
+                    {
+                        .x = forces.x * steeringTime,
+                        .y = acceleration.acceleration.y,
+                        .z = forces.y * steeringTime,
+                    },
+                    steeringTime);
+                velocityComponent.x += cappedAcceleration.x;
+                velocityComponent.y += cappedAcceleration.y;
+                velocityComponent.z += cappedAcceleration.z;
+            }
+            acceleration.acceleration = {0.0f, 0.0f, 0.0f};
+
+            transform.position.x += velocityComponent.x * time;
+            transform.position.y += velocityComponent.y * time;
+            transform.position.z += velocityComponent.z * time;
+        });
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <entt/entt.hpp>
+#include <external/raylib.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <component/area_tracker.hpp>
+#include <component/camera.hpp>
+#include <component/transform.hpp>
+
+namespace System
+{
+    // Decides which agents can do with steering every few ticks instead of every tick, see
+    // SteerAgents. Agents that can't be seen and aren't close to a tower are only there to walk
+    // along the field, so nobody notices if they steer less often. Which tick an agent steers on
+    // depends on its entity id, which spreads them evenly so every tick costs about the same
+    class SteeringLod
+    {
+      public:
+        // Call once per tick before SteerAgents. Agents that aren't interesting steer every
+        // `interval` ticks, 1 steers every agent every tick. aspectRatio is the one of the screen
+        void Update(entt::registry& registry, uint32_t interval, float aspectRatio)
+        {
+            this->interval = std::max(interval, 1u);
+            ++tick;
+
+            viewProjection.reset();
+            for(auto [entity, transform, camera] :
+                registry.view<Component::Transform, Component::Camera>().each())
+            {
+                const Matrix view = MatrixLookAt(transform.position, camera.target, camera.up);
+                Matrix projection;
+                if(camera.projection == CAMERA_PERSPECTIVE)
+                {
+                    projection = MatrixPerspective(
+                        camera.fovy * DEG2RAD,
+                        aspectRatio,
+                        CAMERA_NEAR,
+                        CAMERA_FAR);
+                }
+                else
+                {
+                    const float top = camera.fovy * 0.5f;
+                    const float right = top * aspectRatio;
+                    projection = MatrixOrtho(-right, right, -top, top, CAMERA_NEAR, CAMERA_FAR);
+                }
+                viewProjection = MatrixMultiply(view, projection);
+            }
+
+            trackerAreas.clear();
+            for(auto [entity, transform, tracker] :
+                registry.view<Component::Transform, Component::AreaTracker>().each())
+            {
+                BoundingBox area = tracker.GetBoundingBox(transform);
+                area.min = Vector3SubtractValue(area.min, TRACKER_MARGIN);
+                area.max = Vector3AddValue(area.max, TRACKER_MARGIN);
+                trackerAreas.push_back(area);
+            }
+        }
+
+        // Whether the agent can be seen or is close to a tower. Safe to call from several threads
+        // at once
+        bool IsInteresting(Vector3 position) const
+        {
+            if(viewProjection)
+            {
+                const Quaternion clip = QuaternionTransform(
+                    {position.x, position.y, position.z, 1.0f},
+                    *viewProjection);
+                const float limit = clip.w * (1.0f + SCREEN_MARGIN);
+                if(clip.w > 0.0f && std::abs(clip.x) <= limit && std::abs(clip.y) <= limit)
+                    return true;
+            }
+
+            return std::any_of(
+                trackerAreas.begin(),
+                trackerAreas.end(),
+                [&](const BoundingBox& area) {
+                    return position.x >= area.min.x && position.x <= area.max.x
+                           && position.z >= area.min.z && position.z <= area.max.z;
+                });
+        }
+
+        // Makes room to remember when each of the agents last steered. Has to be called with
+        // every agent before GetSteeringTicks
+        void Track(std::span<const entt::entity> agents)
+        {
+            for(entt::entity agent : agents)
+            {
+                const auto index = (size_t)entt::to_entity(agent);
+                if(index >= lastSteered.size())
+                    lastSteered.resize(index + 1, {.entity = entt::null, .tick = 0});
+            }
+        }
+
+        // False if GetSteeringTicks is sure to return 0 for the agent this tick. Doesn't look for
+        // neighbours, so it is cheap enough to ask before deciding what to gather for the agents
+        bool MightSteer(entt::entity entity, Vector3 position) const
+        {
+            const auto index = (size_t)entt::to_entity(entity);
+            return interval <= 1 || (index + tick) % interval == 0 || IsInteresting(position);
+        }
+
+        // How many ticks of steering the agent should do this tick, 0 if it skips this tick.
+        // Interesting agents steer every tick, the rest only every `interval` ticks. Either way
+        // they steer for as many ticks as it has been since they last steered. Safe to call from
+        // several threads at once as long as every thread has its own agents
+        uint32_t GetSteeringTicks(entt::entity entity, bool interesting)
+        {
+            const auto index = (size_t)entt::to_entity(entity);
+            if(!interesting && interval > 1 && (index + tick) % interval != 0)
+                return 0;
+
+            // An agent that hasn't steered before, or whose id has been reused, steers for a
+            // single tick. Longer than the interval only happens if the interval was lowered
+            LastSteered& last = lastSteered[index];
+            const uint32_t ticks =
+                last.entity == entity ? std::clamp(tick - last.tick, 1u, interval) : 1;
+            last = {.entity = entity, .tick = tick};
+            return ticks;
+        }
+
+      private:
+        // Same as BeginMode3D
+        static constexpr float CAMERA_NEAR = 0.01f;
+        static constexpr float CAMERA_FAR = 1000.0f;
+        // Agents just outside of the screen are included so they look right when they walk in,
+        // as a fraction of the screen size
+        static constexpr float SCREEN_MARGIN = 0.1f;
+        // Same for agents about to walk into a tower's range
+        static constexpr float TRACKER_MARGIN = 2.0f;
+
+        uint32_t interval = 1;
+        uint32_t tick = 0;
+        // Indexed by entity index, see Track
+        struct LastSteered
+        {
+            entt::entity entity;
+            uint32_t tick;
+        };
+        std::vector<LastSteered> lastSteered;
+        std::optional<Matrix> viewProjection;
+        std::vector<BoundingBox> trackerAreas;
+    };
+}
@@ -0,0 +1,100 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+#ifndef PLATFORM_WEB
+    if(threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+    threads.reserve(threadCount);
+    for(uint32_t i = 0; i < threadCount; ++i)
+        threads.emplace_back([this]() { WorkerLoop(); });
+#endif
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stop = true;
+    }
+    wakeCondition.notify_all();
+
+    for(std::thread& thread : threads)
+        thread.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    if(threads.empty() || count <= 1)
+    {
+        for(size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        job = &func;
+        jobCount = count;
+        nextIndex = 0;
+        remaining = count;
+        ++jobGeneration;
+    }
+    wakeCondition.notify_all();
+
+    RunJob();
+
+    // Workers that joined late may still be holding an index past the end, wait for them too so
+    // the next job can't be mixed up with this one
+    std::unique_lock lock(mutex);
+    doneCondition.wait(lock, [this]() { return remaining == 0 && activeWorkers == 0; });
+    job = nullptr;
+}
+
+uint32_t ThreadPool::GetThreadCount() const
+{
+    return (uint32_t)threads.size();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    uint64_t seenGeneration = 0;
+    while(true)
+    {
+        std::unique_lock lock(mutex);
+        wakeCondition.wait(lock, [&]() { return stop || jobGeneration != seenGeneration; });
+        if(stop)
+            return;
+
+        seenGeneration = jobGeneration;
+        // The job may already be done by the time this thread wakes up
+        if(!job)
+            continue;
+
+        activeWorkers++;
+        lock.unlock();
+
+        RunJob();
+
+        lock.lock();
+        activeWorkers--;
+        lock.unlock();
+        doneCondition.notify_one();
+    }
+}
+
+void ThreadPool::RunJob()
+{
+    while(true)
+    {
+        const size_t index = nextIndex.fetch_add(1);
+        if(index >= jobCount)
+            return;
+
+        (*job)(index);
+        remaining.fetch_sub(1);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that only knows how to do one thing: split a range of indices
+// between them. The calling thread helps out and blocks until the whole range is done.
+//
+// There are no threads on the web build, everything runs on the calling thread there
+class ThreadPool
+{
+  public:
+    // 0 uses one thread less than the number of hardware threads since the caller helps out
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Calls func(i) for every i in [0, count). func must be safe to call from several threads at
+    // once, and must not call ParallelFor itself
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    // Does not include the calling thread
+    uint32_t GetThreadCount() const;
+
+  private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    bool stop = false;
+
+    // Only modified while holding `mutex` and no worker is running the job
+    const std::function<void(size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    uint64_t jobGeneration = 0;
+    uint32_t activeWorkers = 0;
+
+    std::atomic<size_t> nextIndex = 0;
+    std::atomic<size_t> remaining = 0;
+
+    void WorkerLoop();
+    void RunJob();
+};
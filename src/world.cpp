@@ -3,6 +3,7 @@
 #include <array>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <entt/entity/utility.hpp>
 #include <fstream>
 #include <iostream>
@@ -11,6 +12,7 @@
 
 #include <assets.hpp>
 #include <component/behaviour.hpp>
+#include <component/move_towards.hpp>
 #include <external/raylib.hpp>
 #include <lua_impl/lua_register.hpp>
 #include <lua_impl/lua_register_types.hpp>
@@ -25,6 +27,8 @@
 #include <system/max_range.hpp>
 #include <system/move_entities.hpp>
 #include <system/navigate.hpp>
+#include <system/steer_agents.hpp>
+#include <system/steering_lod.hpp>
 #include <system/update_projectiles.hpp>
 
 namespace World
@@ -90,6 +94,15 @@ namespace World
                 lua_pop(state.lua, 1);
             }>();
 
+        // Navigation works with field handles rather than ids, so resolve the handle once when
+        // the component is created. System::Navigate resolves it again if navigation is rebuilt
+        state.registry->on_construct<Component::MoveTowards>()
+            .connect<[](entt::registry& registry, entt::entity entity) {
+                auto& moveTowards = registry.get<Component::MoveTowards>(entity);
+                moveTowards.fieldHandle =
+                    state.navigation.ResolveField((int32_t)moveTowards.vectorFieldId);
+            }>();
+
         lua_createtable(state.lua, 0, 0);
 
         // I don't like this being here. It magically sets a global variables that is "owned" by
@@ -130,13 +143,105 @@ namespace World
         lua_pop(lua, 1);
         lua_getfield(lua, -1, "obstacleLookAhead");
         const float obstacleT = (float)lua_tonumber(lua, -1);
+        lua_pop(lua, 1);
+        lua_getfield(lua, -1, "interpolateForces");
+        const bool interpolateForces = lua_toboolean(lua, -1);
+        lua_pop(lua, 1);
+        lua_getfield(lua, -1, "parallelSteering");
+        const bool parallelSteering = lua_toboolean(lua, -1);
+        lua_pop(lua, 1);
+        lua_getfield(lua, -1, "fusedSteering");
+        const bool fusedSteering = lua_toboolean(lua, -1);
+        lua_pop(lua, 1);
+        lua_getfield(lua, -1, "steeringLodInterval");
+        const auto steeringLodInterval = (uint32_t)std::max(lua_tointeger(lua, -1), (lua_Integer)1);
+        lua_pop(lua, 1);
+        lua_getfield(lua, -1, "avoidanceModel");
+        const char* avoidanceModelName = lua_tostring(lua, -1);
+        System::AvoidanceModel avoidanceModel = System::AvoidanceModel::FORCES;
+        if(avoidanceModelName && std::strcmp(avoidanceModelName, "orca") == 0)
+            avoidanceModel = System::AvoidanceModel::ORCA;
+        else if(avoidanceModelName && std::strcmp(avoidanceModelName, "density") == 0)
+            avoidanceModel = System::AvoidanceModel::DENSITY;
         lua_pop(lua, 2);
 
-        PROFILE_CALL(System::Navigate, *state.registry, state.navigation, ksi, time);
-        PROFILE_CALL(System::AvoidEntities, *state.registry, ksi, avoidanceT, time);
-        PROFILE_CALL(System::AvoidObstacles, *state.registry, state.navigation, obstacleT, time);
-        PROFILE_CALL(System::CalculateVelocity, *state.registry, time);
-        PROFILE_CALL(System::MoveEntities, *state.registry, time);
+        // Each steering system only writes to the agent it is working on, so the agents can be
+        // split between threads
+        ThreadPool* steeringThreads = parallelSteering ? &state.threadPool : nullptr;
+
+        // Agents off screen and away from towers, or with nothing around them, steer less often
+        static System::SteeringLod steeringLod;
+        steeringLod.Update(
+            *state.registry,
+            steeringLodInterval,
+            (float)GetScreenWidth() / (float)std::max(GetScreenHeight(), 1));
+
+        // Requested paths are worked on a bit every frame so a burst of requests doesn't stall
+        PROFILE_CALL(state.pathService.Update, state.navigation, 4096);
+        if(fusedSteering)
+        {
+            PROFILE_CALL(
+                System::SteerAgents,
+                *state.registry,
+                state.navigation,
+                ksi,
+                avoidanceT,
+                obstacleT,
+                time,
+                interpolateForces,
+                avoidanceModel,
+                steeringLodInterval > 1 ? &steeringLod : nullptr,
+                steeringThreads);
+            // The agents have already been moved
+            auto steeredAgents = System::GetSteeredAgents(*state.registry);
+            auto isSteered = [&](entt::entity entity) { return steeredAgents.contains(entity); };
+            PROFILE_CALL(System::CalculateVelocity, *state.registry, time, isSteered);
+            PROFILE_CALL(System::MoveEntities, *state.registry, time, isSteered);
+        }
+        else
+        {
+            // The same thing one system at a time, which is easier to debug. Every agent steers
+            // every tick
+            PROFILE_CALL(
+                System::Navigate,
+                *state.registry,
+                state.navigation,
+                ksi,
+                time,
+                interpolateForces,
+                steeringThreads);
+            if(avoidanceModel != System::AvoidanceModel::ORCA)
+            {
+                PROFILE_CALL(
+                    System::AvoidEntities,
+                    *state.registry,
+                    state.navigation,
+                    ksi,
+                    avoidanceT,
+                    time,
+                    avoidanceModel,
+                    steeringThreads);
+                PROFILE_CALL(
+                    System::AvoidObstacles,
+                    *state.registry,
+                    state.navigation,
+                    obstacleT,
+                    time,
+                    steeringThreads);
+            }
+            else
+            {
+                PROFILE_CALL(
+                    System::AvoidEntitiesOrca,
+                    *state.registry,
+                    state.navigation,
+                    avoidanceT,
+                    time,
+                    steeringThreads);
+            }
+            PROFILE_CALL(System::CalculateVelocity, *state.registry, time);
+            PROFILE_CALL(System::MoveEntities, *state.registry, time);
+        }
         PROFILE_CALL(System::AlignTiles, *state.registry);
         PROFILE_CALL(System::UpdateProjectiles, *state.registry);
         PROFILE_CALL(System::MaxRange, *state.registry);
@@ -168,7 +273,7 @@ namespace World
         state.drawNavigationTiles = lua_toboolean(lua, -1);
         lua_pop(lua, 2);
         if(state.drawNavigationTiles)
-            state.navigation.DrawTiles();
+            state.navigationDebugDraw.DrawTiles(state.navigation);
 
         lua_getglobal(lua, "Navigation");
         if(lua_getfield(lua, -1, "drawField") == LUA_TNUMBER)
@@ -177,6 +282,8 @@ namespace World
             state.drawNavigationField = std::nullopt;
         lua_pop(lua, 2);
         if(state.drawNavigationField)
-            state.navigation.DrawField(state.drawNavigationField.value());
+            state.navigationDebugDraw.DrawField(
+                state.navigation,
+                state.drawNavigationField.value());
     }
 }
\ No newline at end of file
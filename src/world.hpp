@@ -1,6 +1,9 @@
 #include <entt/entt.hpp>
 #include <navigation.hpp>
+#include <navigation_debug_draw.hpp>
 #include <optional>
+#include <path_service.hpp>
+#include <thread_pool.hpp>
 
 struct lua_State;
 
@@ -18,6 +21,9 @@ namespace World
         bool drawNavigationTiles = false;
         std::optional<int32_t> drawNavigationField;
         Navigation navigation;
+        PathService pathService;
+        NavigationDebugDraw navigationDebugDraw;
+        ThreadPool threadPool;
     };
     // This is global because lua needs access to the variables inside it (see lua_world_impl). A
     // global variable can be directly accessed from C functions and lambdas (in other words,